@@ -0,0 +1,65 @@
+/* buffer_growth.c - hoedown_buffer growth strategy benchmark
+ *
+ * Appends 1 MB and 100 MB of HTML-sized chunks to a buffer created with
+ * the binding's unit of 16, once with linear and once with geometric
+ * growth, and reports the time and number of reallocations of each.
+ *
+ *	cc -O2 -o buffer_growth bench/buffer_growth.c ext/hoedown/buffer.c
+ *	./buffer_growth
+ */
+
+#include "../ext/hoedown/buffer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char chunk[] = "<p>Some <em>emphasised</em> text.</p>\n";
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(const char *name, hoedown_bufgrowth_t growth, size_t total)
+{
+	hoedown_buffer *buf = hoedown_buffer_new(16);
+	size_t reallocs = 0, asize = 0;
+	double start;
+
+	buf->growth = growth;
+	start = now();
+
+	while (buf->size < total) {
+		HOEDOWN_BUFPUTSL(buf, chunk);
+
+		if (buf->asize != asize) {
+			asize = buf->asize;
+			reallocs++;
+		}
+	}
+
+	printf("%-10s %4zu MB  %9.3f ms  %9zu reallocs\n",
+		name, total >> 20, (now() - start) * 1e3, reallocs);
+
+	hoedown_buffer_free(buf);
+}
+
+int
+main(void)
+{
+	static const size_t sizes[] = { 1 << 20, 100 << 20 };
+	size_t i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		run("linear", HOEDOWN_BUF_GROW_LINEAR, sizes[i]);
+		run("geometric", HOEDOWN_BUF_GROW_GEOMETRIC, sizes[i]);
+	}
+
+	return 0;
+}
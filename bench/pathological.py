@@ -0,0 +1,51 @@
+# -*- coding: utf-8 -*-
+
+"""pathological.py - render time of adversarial inputs as they double
+
+Renders every input of the corpus in test/pathological.py at four doubling
+sizes with the built extension, and reports the times and the power of the
+size they grew with; a power past 1.5 is flagged and makes the exit status 1.
+
+    python setup.py build_ext --inplace
+    python bench/pathological.py [--doublings N] [kind ...]
+"""
+
+from __future__ import print_function, unicode_literals
+
+from os import path as op
+import sys
+
+sys.path.insert(0, op.dirname(op.dirname(op.abspath(__file__))))
+
+from test.pathological import CORPUS, PathologicalTestCase, exponent, growth
+
+
+def main(args):
+    doublings = 3
+    
+    if args[:1] == ['--doublings']:
+        doublings = int(args[1])
+        args = args[2:]
+    
+    slow = 0
+    
+    for kind in sorted(CORPUS):
+        if args and kind not in args:
+            continue
+        
+        for name, make, extensions in CORPUS[kind]:
+            sizes, times = growth(make, extensions, doublings)
+            power = exponent(times)
+            flag = '  super-linear' if power > PathologicalTestCase.limit else ''
+            
+            print('{0:<18} {1:<14} {2:>8} .. {3:<8} {4}  {5:5.2f}{6}'.format(
+                kind, name, sizes[0], sizes[-1],
+                ' '.join('{0:8.3f} ms'.format(t * 1e3) for t in times), power, flag))
+            
+            slow += bool(flag)
+    
+    return 1 if slow else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -5,17 +5,58 @@
 #include <string.h>
 #include <assert.h>
 
+static hoedown_allocator allocator = { malloc, calloc, realloc, free };
+
+/* hoedown_set_allocator: replaces the memory functions of the library */
+void
+hoedown_set_allocator(const hoedown_allocator *alloc)
+{
+	if (alloc) {
+		allocator = *alloc;
+	} else {
+		allocator.malloc = malloc;
+		allocator.calloc = calloc;
+		allocator.realloc = realloc;
+		allocator.free = free;
+	}
+}
+
+void *
+hoedown_malloc(size_t size)
+{
+	return allocator.malloc(size);
+}
+
+void *
+hoedown_calloc(size_t nmemb, size_t size)
+{
+	return allocator.calloc(nmemb, size);
+}
+
+void *
+hoedown_realloc(void *ptr, size_t size)
+{
+	return allocator.realloc(ptr, size);
+}
+
+void
+hoedown_free(void *ptr)
+{
+	allocator.free(ptr);
+}
+
 /* hoedown_buffer_new: allocation of a new buffer */
 hoedown_buffer *
 hoedown_buffer_new(size_t unit)
 {
 	hoedown_buffer *ret;
-	ret = malloc(sizeof (hoedown_buffer));
+	ret = hoedown_malloc(sizeof (hoedown_buffer));
 
 	if (ret) {
 		ret->data = 0;
 		ret->size = ret->asize = 0;
 		ret->unit = unit;
+		ret->growth = HOEDOWN_BUF_GROW_GEOMETRIC;
 	}
 	return ret;
 }
@@ -27,8 +68,8 @@ hoedown_buffer_free(hoedown_buffer *buf)
 	if (!buf)
 		return;
 
-	free(buf->data);
-	free(buf);
+	hoedown_free(buf->data);
+	hoedown_free(buf);
 }
 
 /* hoedown_buffer_reset: frees internal data of the buffer */
@@ -38,7 +79,7 @@ hoedown_buffer_reset(hoedown_buffer *buf)
 	if (!buf)
 		return;
 
-	free(buf->data);
+	hoedown_free(buf->data);
 	buf->data = NULL;
 	buf->size = buf->asize = 0;
 }
@@ -55,11 +96,25 @@ hoedown_buffer_grow(hoedown_buffer *buf, size_t neosz)
 	if (buf->asize >= neosz)
 		return HOEDOWN_BUF_OK;
 
-	neoasz = buf->asize + buf->unit;
-	while (neoasz < neosz)
-		neoasz += buf->unit;
+	if (buf->growth == HOEDOWN_BUF_GROW_LINEAR) {
+		neoasz = buf->asize + buf->unit;
+		while (neoasz < neosz)
+			neoasz += buf->unit;
+	} else {
+		/* 1.5x the current size, never less than one unit more, rounded
+		 * up to a whole number of units */
+		neoasz = buf->asize + (buf->asize >> 1);
+		if (neoasz < buf->asize + buf->unit)
+			neoasz = buf->asize + buf->unit;
+		if (neoasz < neosz)
+			neoasz = neosz;
+
+		neoasz = ((neoasz + buf->unit - 1) / buf->unit) * buf->unit;
+		if (neoasz < neosz)
+			return HOEDOWN_BUF_ENOMEM;
+	}
 
-	neodata = realloc(buf->data, neoasz);
+	neodata = hoedown_realloc(buf->data, neoasz);
 	if (!neodata)
 		return HOEDOWN_BUF_ENOMEM;
 
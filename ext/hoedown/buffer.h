@@ -21,20 +21,45 @@ typedef enum {
 	HOEDOWN_BUF_ENOMEM = -1
 } hoedown_buferror_t;
 
+typedef enum {
+	HOEDOWN_BUF_GROW_GEOMETRIC = 0,	/* grow by half the allocated size (default) */
+	HOEDOWN_BUF_GROW_LINEAR = 1	/* grow by `unit` bytes at a time */
+} hoedown_bufgrowth_t;
+
 /* hoedown_buffer: character array buffer */
 struct hoedown_buffer {
 	uint8_t *data;	/* actual character data */
 	size_t size;	/* size of the string */
 	size_t asize;	/* allocated size (0 = volatile buffer) */
 	size_t unit;	/* reallocation unit size (0 = read-only buffer) */
+	hoedown_bufgrowth_t growth;	/* reallocation strategy */
 };
 
 typedef struct hoedown_buffer hoedown_buffer;
 
+/* hoedown_allocator: memory functions used throughout the library */
+struct hoedown_allocator {
+	void *(*malloc)(size_t size);
+	void *(*calloc)(size_t nmemb, size_t size);
+	void *(*realloc)(void *ptr, size_t size);
+	void (*free)(void *ptr);
+};
+
+typedef struct hoedown_allocator hoedown_allocator;
+
 /* HOEDOWN_BUFPUTSL: optimized hoedown_buffer_puts of a string literal */
 #define HOEDOWN_BUFPUTSL(output, literal) \
 	hoedown_buffer_put(output, literal, sizeof(literal) - 1)
 
+/* hoedown_set_allocator: replaces the memory functions of the library (NULL restores the C library's); must be called before anything is allocated */
+void hoedown_set_allocator(const hoedown_allocator *allocator);
+
+/* hoedown_malloc, hoedown_calloc, hoedown_realloc, hoedown_free: the current memory functions */
+void *hoedown_malloc(size_t size) __attribute__ ((malloc));
+void *hoedown_calloc(size_t nmemb, size_t size) __attribute__ ((malloc));
+void *hoedown_realloc(void *ptr, size_t size);
+void hoedown_free(void *ptr);
+
 /* hoedown_buffer_new: allocation of a new buffer */
 hoedown_buffer *hoedown_buffer_new(size_t unit) __attribute__ ((malloc));
 
@@ -7,16 +7,21 @@
 #include <ctype.h>
 #include <stdio.h>
 
+#include "scan.h"
 #include "stack.h"
 
 #ifdef _MSC_VER
 #define strncasecmp	_strnicmp
 #endif
 
-#define REF_TABLE_SIZE 8
+#define REF_TABLE_SIZE 16
+
+#define ARENA_CHUNK_SIZE 4096
 
 #define BUFFER_BLOCK 0
 #define BUFFER_SPAN 1
+#define BUFFER_LINES 2
+#define BUFFER_INLINE 3
 
 #define HOEDOWN_LI_END 8	/* internal list flag */
 
@@ -26,19 +31,33 @@ const char *hoedown_find_block_tag(const char *str, unsigned int len);
  * LOCAL TYPES *
  ***************/
 
+/* ref_key: case-insensitive name of a link or footnote reference */
+struct ref_key {
+	unsigned int id;
+
+	const uint8_t *name;
+	size_t size;
+};
+
+/* ref_table: open-addressing hash table of references, keyed by name */
+struct ref_table {
+	struct ref_key **slots;
+	size_t size;	/* number of slots, a power of two */
+	size_t count;
+	size_t longest;	/* size of the longest name */
+};
+
 /* link_ref: reference to a link */
 struct link_ref {
-	unsigned int id;
+	struct ref_key key;
 
 	hoedown_buffer *link;
 	hoedown_buffer *title;
-
-	struct link_ref *next;
 };
 
 /* footnote_ref: reference to a footnote */
 struct footnote_ref {
-	unsigned int id;
+	struct ref_key key;
 
 	int is_used;
 	unsigned int num;
@@ -59,6 +78,96 @@ struct footnote_list {
 	struct footnote_item *tail;
 };
 
+/* line: a line of the text given to parse_block, newline included */
+struct line {
+	uint8_t *data;
+	size_t size;
+	uint8_t indent;	/* leading spaces, up to UINT8_MAX */
+	uint8_t first;	/* first byte after them */
+	uint8_t blank;	/* nothing but spaces before the newline */
+};
+
+/* EMPH_ kinds: the closers searched for by parse_emph1, 2 and 3 */
+enum {
+	EMPH_SINGLE = (1 << 0),
+	EMPH_DOUBLE = (1 << 1),
+	EMPH_TRIPLE = (1 << 2)
+};
+
+/* closer: an opening delimiter of an inline run and where its closer starts */
+struct closer {
+	size_t pos;
+	size_t closer;	/* NO_CLOSER if there is none */
+};
+
+#define NO_CLOSER ((size_t)-1)
+
+/* next_byte: the first occurrence of a byte at or after any position in
+ * [from, at], at being the size of the run if there is none */
+struct next_byte {
+	size_t from;
+	size_t at;
+};
+
+/* inline_run: the text given to parse_inline, with the indexes built on
+ * demand while it is parsed */
+struct inline_run {
+	const uint8_t *data;
+	size_t size;
+	hoedown_buffer *emph_dead;	/* EMPH_ kinds with no closer after each byte */
+	hoedown_buffer *code_closers;	/* struct closer of every backtick */
+	size_t code_cursor;
+	int code_misses;
+	hoedown_buffer *link_closers;	/* struct closer of every '[' */
+	size_t link_cursor;
+	size_t link_scanned;	/* bytes scanned for ']' without the index */
+	struct next_byte next_bracket;
+	struct next_byte next_paren;
+	struct next_byte next_angle;
+	struct next_byte next_backslash;
+	struct inline_run *parent;
+};
+
+#define HTML_TAG_MAX 32
+#define HTML_END_TAGS 32
+
+/* html_end: how many bytes at the end of the block run hold no closing tag
+ * for tag past the first line of a block, for each pass of htmlblock_end */
+struct html_end {
+	const char *tag;
+	size_t tail[2];
+};
+
+/* block_run: the text given to parse_block, with what is known about where
+ * the HTML blocks starting in it can end */
+struct block_run {
+	const uint8_t *data;
+	size_t size;
+	struct html_end html_ends[HTML_END_TAGS];
+	size_t html_end_count;
+	struct next_byte next_angle;	/* '>' closing a <hr */
+	struct next_byte next_comment;	/* "-->" closing a comment */
+	struct block_run *parent;
+};
+
+/* arena_chunk: block of memory handed out by an arena */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+/* arena: bump-pointer allocator for the objects that live for one render */
+struct arena {
+	struct arena_chunk *head;
+};
+
+/* hoedown_references: link references shared by many renders */
+struct hoedown_references {
+	struct ref_table table;
+	struct arena arena;
+};
+
 /* char_trigger: function pointer to render active chars */
 /*   returns the number of chars taken care of */
 /*   data is the pointer of the beginning of the span */
@@ -111,15 +220,34 @@ static char_trigger markdown_char_ptrs[] = {
 	&char_quote
 };
 
+/* markdown_block_t • block constructs that may start with a given byte,
+ * once the indentation of the line has been skipped */
+enum markdown_block_t {
+	MD_BLOCK_ATXHEADER = (1 << 0),
+	MD_BLOCK_SETEXT = (1 << 1),
+	MD_BLOCK_HTML = (1 << 2),
+	MD_BLOCK_HRULE = (1 << 3),
+	MD_BLOCK_FENCE = (1 << 4),
+	MD_BLOCK_QUOTE = (1 << 5),
+	MD_BLOCK_ULI = (1 << 6),
+	MD_BLOCK_OLI = (1 << 7)
+};
+
 /* render • structure containing state for a parser instance */
 struct hoedown_document {
 	hoedown_renderer md;
 
-	struct link_ref *refs[REF_TABLE_SIZE];
-	struct footnote_list footnotes_found;
+	struct ref_table refs;
+	const hoedown_references *references;
+	struct ref_table footnotes_found;
 	struct footnote_list footnotes_used;
+	struct arena arena;
 	uint8_t active_char[256];
-	hoedown_stack work_bufs[2];
+	hoedown_scanner active_scan;
+	uint8_t block_char[256];
+	hoedown_stack work_bufs[4];
+	struct inline_run *run;
+	struct block_run *block;
 	unsigned int ext_flags;
 	size_t max_nesting;
 	int in_link_body;
@@ -132,7 +260,7 @@ struct hoedown_document {
 static inline hoedown_buffer *
 newbuf(hoedown_document *doc, int type)
 {
-	static const size_t buf_size[2] = {256, 64};
+	static const size_t buf_size[4] = {256, 64, 64 * sizeof(struct line), 256};
 	hoedown_buffer *work = NULL;
 	hoedown_stack *pool = &doc->work_bufs[type];
 
@@ -174,88 +302,284 @@ unscape_text(hoedown_buffer *ob, hoedown_buffer *src)
 	}
 }
 
+/* arena allocations are aligned for any of the structures they hold */
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+/* arena_alloc • returns zeroed memory that lives until the arena is reset */
+static void *
+arena_alloc(struct arena *arena, size_t size)
+{
+	static const size_t header = ARENA_ROUND(sizeof(struct arena_chunk));
+	struct arena_chunk *chunk = arena->head;
+	uint8_t *ptr;
+
+	size = ARENA_ROUND(size);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		/* chunks double in size, so the newest is always the largest */
+		size_t chunk_size = chunk ? chunk->size * 2 : ARENA_CHUNK_SIZE;
+		while (chunk_size < size)
+			chunk_size *= 2;
+
+		chunk = hoedown_malloc(header + chunk_size);
+		if (!chunk)
+			return NULL;
+
+		chunk->next = arena->head;
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		arena->head = chunk;
+	}
+
+	ptr = (uint8_t *)chunk + header + chunk->used;
+	chunk->used += size;
+
+	memset(ptr, 0x0, size);
+	return ptr;
+}
+
+/* arena_buffer • returns a read-only copy of data living in the arena */
+static hoedown_buffer *
+arena_buffer(struct arena *arena, const uint8_t *data, size_t size)
+{
+	hoedown_buffer *buf = arena_alloc(arena, sizeof(hoedown_buffer) + size);
+
+	if (!buf)
+		return NULL;
+
+	buf->data = (uint8_t *)(buf + 1);
+	buf->size = size;
+	memcpy(buf->data, data, size);
+
+	return buf;
+}
+
+/* arena_reset • empties the arena, keeping only its largest chunk */
+static void
+arena_reset(struct arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+
+	if (!arena->head)
+		return;
+
+	for (chunk = arena->head->next; chunk; chunk = next) {
+		next = chunk->next;
+		hoedown_free(chunk);
+	}
+
+	arena->head->next = NULL;
+	arena->head->used = 0;
+}
+
+static void
+arena_free(struct arena *arena)
+{
+	arena_reset(arena);
+	hoedown_free(arena->head);
+	arena->head = NULL;
+}
+
+/* ASCII case folding, reference names are matched case-insensitively */
+static const uint8_t fold_case[UINT8_MAX+1] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40,  'a',  'b',  'c',  'd',  'e',  'f',  'g',  'h',  'i',  'j',  'k',  'l',  'm',  'n',  'o',
+	 'p',  'q',  'r',  's',  't',  'u',  'v',  'w',  'x',  'y',  'z', 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+/* hash_link_ref • FNV-1a over the case-folded name, with a final
+ * avalanche so that the low bits used for the table index are well mixed */
 static unsigned int
 hash_link_ref(const uint8_t *link_ref, size_t length)
 {
 	size_t i;
-	unsigned int hash = 0;
+	uint32_t hash = 2166136261u;
 
-	for (i = 0; i < length; ++i)
-		hash = tolower(link_ref[i]) + (hash << 6) + (hash << 16) - hash;
+	for (i = 0; i < length; ++i) {
+		hash ^= fold_case[link_ref[i]];
+		hash *= 16777619u;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
 
 	return hash;
 }
 
-static struct link_ref *
-add_link_ref(
-	struct link_ref **references,
-	const uint8_t *name, size_t name_size)
+static int
+equal_link_ref(const uint8_t *a, const uint8_t *b, size_t length)
 {
-	struct link_ref *ref = calloc(1, sizeof(struct link_ref));
+	size_t i;
 
-	if (!ref)
+	for (i = 0; i < length; ++i)
+		if (fold_case[a[i]] != fold_case[b[i]])
+			return 0;
+
+	return 1;
+}
+
+static struct ref_key *
+find_ref(const struct ref_table *table, const uint8_t *name, size_t length)
+{
+	unsigned int hash;
+	size_t i, mask;
+	struct ref_key *key;
+
+	if (!table->count || length > table->longest)
 		return NULL;
 
-	ref->id = hash_link_ref(name, name_size);
-	ref->next = references[ref->id % REF_TABLE_SIZE];
+	hash = hash_link_ref(name, length);
+	mask = table->size - 1;
 
-	references[ref->id % REF_TABLE_SIZE] = ref;
-	return ref;
+	for (i = hash & mask; (key = table->slots[i]) != NULL; i = (i + 1) & mask) {
+		if (key->id == hash && key->size == length &&
+			equal_link_ref(key->name, name, length))
+			return key;
+	}
+
+	return NULL;
 }
 
-static struct link_ref *
-find_link_ref(struct link_ref **references, uint8_t *name, size_t length)
+/* add_ref • inserts a key not yet in the table, keeping it at most half full */
+static int
+add_ref(struct arena *arena, struct ref_table *table, struct ref_key *key)
 {
-	unsigned int hash = hash_link_ref(name, length);
-	struct link_ref *ref = NULL;
+	size_t i, mask;
 
-	ref = references[hash % REF_TABLE_SIZE];
+	if ((table->count + 1) * 2 > table->size) {
+		size_t size = table->size ? table->size * 2 : REF_TABLE_SIZE;
+		struct ref_key **slots = arena_alloc(arena, size * sizeof(struct ref_key *));
 
-	while (ref != NULL) {
-		if (ref->id == hash)
-			return ref;
+		if (!slots)
+			return 0;
 
-		ref = ref->next;
+		for (i = 0; i < table->size; ++i) {
+			struct ref_key *old = table->slots[i];
+			size_t j;
+
+			if (!old)
+				continue;
+
+			for (j = old->id & (size - 1); slots[j]; j = (j + 1) & (size - 1));
+			slots[j] = old;
+		}
+
+		table->slots = slots;
+		table->size = size;
 	}
 
-	return NULL;
+	mask = table->size - 1;
+	for (i = key->id & mask; table->slots[i]; i = (i + 1) & mask);
+
+	table->slots[i] = key;
+	table->count++;
+
+	if (key->size > table->longest)
+		table->longest = key->size;
+
+	return 1;
 }
 
 static void
-free_link_refs(struct link_ref **references)
+set_ref_key(struct ref_key *key, const uint8_t *name, size_t name_size)
 {
-	size_t i;
+	key->id = hash_link_ref(name, name_size);
+	key->name = name;
+	key->size = name_size;
+}
 
-	for (i = 0; i < REF_TABLE_SIZE; ++i) {
-		struct link_ref *r = references[i];
-		struct link_ref *next;
+static struct link_ref *
+find_link_ref(const struct ref_table *table, const uint8_t *name, size_t length)
+{
+	return (struct link_ref *)find_ref(table, name, length);
+}
 
-		while (r) {
-			next = r->next;
-			hoedown_buffer_free(r->link);
-			hoedown_buffer_free(r->title);
-			free(r);
-			r = next;
-		}
+/* lookup_link_ref • finds a reference of the document, or else one of the
+ * shared references */
+static struct link_ref *
+lookup_link_ref(hoedown_document *doc, const uint8_t *name, size_t length)
+{
+	struct link_ref *ref = find_link_ref(&doc->refs, name, length);
+
+	if (!ref && doc->references)
+		ref = find_link_ref(&doc->references->table, name, length);
+
+	return ref;
+}
+
+/* link_ref_fits • whether the id crafted from size bytes of link text can be
+ * as short as a reference name; folding newlines drops at most every other
+ * byte */
+static int
+link_ref_fits(hoedown_document *doc, size_t size)
+{
+	size_t longest = doc->refs.longest;
+
+	if (doc->references && doc->references->table.longest > longest)
+		longest = doc->references->table.longest;
+
+	return size / 2 <= longest;
+}
+
+/* add_link_ref • returns the (emptied) reference for name; a later
+ * definition of the same name replaces an earlier one */
+static struct link_ref *
+add_link_ref(
+	struct arena *arena, struct ref_table *table,
+	const uint8_t *name, size_t name_size)
+{
+	struct link_ref *ref = find_link_ref(table, name, name_size);
+
+	if (ref) {
+		ref->link = ref->title = NULL;
+		return ref;
 	}
+
+	ref = arena_alloc(arena, sizeof(struct link_ref));
+	if (!ref)
+		return NULL;
+
+	set_ref_key(&ref->key, name, name_size);
+
+	if (!add_ref(arena, table, &ref->key))
+		return NULL;
+
+	return ref;
 }
 
 static struct footnote_ref *
-create_footnote_ref(struct footnote_list *list, const uint8_t *name, size_t name_size)
+create_footnote_ref(struct arena *arena, const uint8_t *name, size_t name_size)
 {
-	struct footnote_ref *ref = calloc(1, sizeof(struct footnote_ref));
+	struct footnote_ref *ref = arena_alloc(arena, sizeof(struct footnote_ref));
 	if (!ref)
 		return NULL;
 	
-	ref->id = hash_link_ref(name, name_size);
+	set_ref_key(&ref->key, name, name_size);
 	
 	return ref;
 }
 
 static int
-add_footnote_ref(struct footnote_list *list, struct footnote_ref *ref)
+add_footnote_ref(struct arena *arena, struct footnote_list *list, struct footnote_ref *ref)
 {
-	struct footnote_item *item = calloc(1, sizeof(struct footnote_item));
+	struct footnote_item *item = arena_alloc(arena, sizeof(struct footnote_item));
 	if (!item)
 		return 0;
 	item->ref = ref;
@@ -272,42 +596,9 @@ add_footnote_ref(struct footnote_list *list, struct footnote_ref *ref)
 }
 
 static struct footnote_ref *
-find_footnote_ref(struct footnote_list *list, uint8_t *name, size_t length)
+find_footnote_ref(const struct ref_table *table, uint8_t *name, size_t length)
 {
-	unsigned int hash = hash_link_ref(name, length);
-	struct footnote_item *item = NULL;
-	
-	item = list->head;
-	
-	while (item != NULL) {
-		if (item->ref->id == hash)
-			return item->ref;
-		item = item->next;
-	}
-	
-	return NULL;
-}
-
-static void
-free_footnote_ref(struct footnote_ref *ref)
-{
-	hoedown_buffer_free(ref->contents);
-	free(ref);
-}
-
-static void
-free_footnote_list(struct footnote_list *list, int free_refs)
-{
-	struct footnote_item *item = list->head;
-	struct footnote_item *next;
-	
-	while (item) {
-		next = item->next;
-		if (free_refs)
-			free_footnote_ref(item->ref);
-		free(item);
-		item = next;
-	}
+	return (struct footnote_ref *)find_ref(table, name, length);
 }
 
 
@@ -364,9 +655,53 @@ is_mail_autolink(uint8_t *data, size_t size)
 	return 0;
 }
 
+/* find_next_byte • position of the first ']', ')', '>' or '\\' at or after i
+ * in data, or size; when data ends with the inline run the answer is kept, since it
+ * also holds for the positions up to it */
+static size_t
+find_next_byte(struct inline_run *run, uint8_t *data, size_t i, size_t size, uint8_t c)
+{
+	struct next_byte *cache;
+	uint8_t *found;
+	size_t base;
+
+	if (i >= size)
+		return size;
+
+	if (!run || data + size != run->data + run->size) {
+		found = memchr(data + i, c, size - i);
+		return found ? (size_t)(found - data) : size;
+	}
+
+	switch (c) {
+	case ']': cache = &run->next_bracket; break;
+	case ')': cache = &run->next_paren; break;
+	case '>': cache = &run->next_angle; break;
+	default: cache = &run->next_backslash; break;
+	}
+
+	base = data - run->data;
+
+	/* nested brackets ask from right to left, so a search ending where the
+	 * known span starts extends it */
+	if (base + i < cache->from && cache->from <= cache->at) {
+		found = memchr(data + i, c, cache->from - base - i);
+		cache->from = base + i;
+		if (found)
+			cache->at = found - run->data;
+	}
+	else if (cache->from > base + i || cache->at < base + i) {
+		found = memchr(data + i, c, size - i);
+		cache->from = base + i;
+		cache->at = found ? (size_t)(found - run->data) : run->size;
+	}
+
+	return cache->at - base;
+}
+
 /* tag_length • returns the length of the given tag, or 0 is it's not valid */
 static size_t
-tag_length(uint8_t *data, size_t size, enum hoedown_autolink *autolink)
+tag_length(struct inline_run *run, uint8_t *data, size_t size, enum hoedown_autolink *autolink)
 {
 	size_t i, j;
 
@@ -380,6 +715,10 @@ tag_length(uint8_t *data, size_t size, enum hoedown_autolink *autolink)
 	if (!isalnum(data[i]))
 		return 0;
 
+	/* every kind of tag ends with a '>' */
+	if (find_next_byte(run, data, i, size, '>') >= size)
+		return 0;
+
 	/* scheme test */
 	*autolink = HOEDOWN_AUTOLINK_NONE;
 
@@ -421,7 +760,7 @@ tag_length(uint8_t *data, size_t size, enum hoedown_autolink *autolink)
 	}
 
 	/* looking for sometinhg looking like a tag end */
-	while (i < size && data[i] != '>') i++;
+	i = find_next_byte(run, data, i, size, '>');
 	if (i >= size) return 0;
 	return i + 1;
 }
@@ -433,16 +772,32 @@ parse_inline(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t si
 	size_t i = 0, end = 0;
 	uint8_t action = 0;
 	hoedown_buffer work = { 0, 0, 0, 0 };
+	struct inline_run run;
 
 	if (doc->work_bufs[BUFFER_SPAN].size +
 		doc->work_bufs[BUFFER_BLOCK].size > doc->max_nesting)
 		return;
 
+	run.data = data;
+	run.size = size;
+	run.emph_dead = NULL;
+	run.code_closers = NULL;
+	run.code_cursor = 0;
+	run.code_misses = 0;
+	run.link_closers = NULL;
+	run.link_cursor = 0;
+	run.link_scanned = 0;
+	run.next_bracket.from = run.next_paren.from = 1;
+	run.next_bracket.at = run.next_paren.at = 0;
+	run.next_angle.from = run.next_backslash.from = 1;
+	run.next_angle.at = run.next_backslash.at = 0;
+	run.parent = doc->run;
+	doc->run = &run;
+
 	while (i < size) {
 		/* copying inactive chars into the output */
-		while (end < size && (action = doc->active_char[data[end]]) == 0) {
-			end++;
-		}
+		end = hoedown_scanner_find(&doc->active_scan, data, end, size);
+		action = end < size ? doc->active_char[data[end]] : 0;
 
 		if (doc->md.normal_text) {
 			work.data = data + i;
@@ -463,12 +818,24 @@ parse_inline(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t si
 			end = i;
 		}
 	}
+
+	if (run.emph_dead)
+		popbuf(doc, BUFFER_INLINE);
+
+	if (run.code_closers)
+		popbuf(doc, BUFFER_INLINE);
+
+	if (run.link_closers)
+		popbuf(doc, BUFFER_INLINE);
+
+	doc->run = run.parent;
 }
 
 /* find_emph_char • looks for the next emph uint8_t, skipping other constructs */
 static size_t
-find_emph_char(uint8_t *data, size_t size, uint8_t c)
+find_emph_char(hoedown_document *doc, uint8_t *data, size_t size, uint8_t c)
 {
+	struct inline_run *run = doc->run;
 	size_t i = 1;
 
 	while (i < size) {
@@ -510,16 +877,17 @@ find_emph_char(uint8_t *data, size_t size, uint8_t c)
 		}
 		/* skipping a link */
 		else if (data[i] == '[') {
-			size_t tmp_i = 0;
+			size_t tmp_i = 0, end;
+			uint8_t *found;
 			uint8_t cc;
 
+			/* the first ']' closes the text, nested or not */
 			i++;
-			while (i < size && data[i] != ']') {
-				if (!tmp_i && data[i] == c) tmp_i = i;
-				i++;
-			}
+			end = find_next_byte(run, data, i, size, ']');
+			if (end > i && (found = memchr(data + i, c, end - i)) != NULL)
+				tmp_i = found - data;
 
-			i++;
+			i = end + 1;
 			while (i < size && (data[i] == ' ' || data[i] == '\n'))
 				i++;
 
@@ -541,11 +909,11 @@ find_emph_char(uint8_t *data, size_t size, uint8_t c)
 			}
 
 			i++;
-			while (i < size && data[i] != cc) {
-				if (!tmp_i && data[i] == c) tmp_i = i;
-				i++;
-			}
+			end = find_next_byte(run, data, i, size, cc);
+			if (!tmp_i && end > i && (found = memchr(data + i, c, end - i)) != NULL)
+				tmp_i = found - data;
 
+			i = end;
 			if (i >= size)
 				return tmp_i;
 
@@ -556,77 +924,149 @@ find_emph_char(uint8_t *data, size_t size, uint8_t c)
 	return 0;
 }
 
-/* parse_emph1 • parsing single emphase */
-/* closed by a symbol not preceded by whitespace and not followed by symbol */
+/* is_emph_closer • whether the c at data[i] closes an emphasis of the
+ * given EMPH_ kind, or for EMPH_TRIPLE may close any of them */
+static int
+is_emph_closer(hoedown_document *doc, uint8_t *data, size_t size, uint8_t c, int kind, size_t i)
+{
+	if (data[i] != c || _isspace(data[i - 1]))
+		return 0;
+
+	switch (kind) {
+	case EMPH_SINGLE:
+		return !(doc->ext_flags & HOEDOWN_EXT_NO_INTRA_EMPHASIS) ||
+			i + 1 >= size || !isalnum(data[i + 1]);
+
+	case EMPH_DOUBLE:
+		return i + 1 < size && data[i + 1] == c;
+
+	default:
+		return 1;
+	}
+}
+
+/* find_emph_closer • position of the first closer of the given kind found
+ * by hopping from i with find_emph_char, or 0 if there is none; hops are
+ * deterministic, so every position the search went through is marked in
+ * the inline run and later searches ending up there stop right away */
 static size_t
-parse_emph1(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, uint8_t c)
+find_emph_closer(hoedown_document *doc, uint8_t *data, size_t size, uint8_t c, int kind, size_t i)
 {
-	size_t i = 0, len;
-	hoedown_buffer *work = 0;
-	int r;
+	struct inline_run *run = doc->run;
+	uint8_t *dead = NULL;
+	size_t start = i, len;
 
-	/* skipping one symbol if coming from emph3 */
-	if (size > 1 && data[0] == c && data[1] == c) i = 1;
+	/* the emphasis parsers all search up to the end of the run */
+	if (!run || data + size != run->data + run->size)
+		run = NULL;
+	else if (run->emph_dead)
+		dead = run->emph_dead->data + (data - run->data);
 
 	while (i < size) {
-		len = find_emph_char(data + i, size - i, c);
-		if (!len) return 0;
+		len = find_emph_char(doc, data + i, size - i, c);
+		if (!len)
+			break;
 		i += len;
-		if (i >= size) return 0;
 
-		if (data[i] == c && !_isspace(data[i - 1])) {
+		if (dead && (dead[i] & kind))
+			break;
 
-			if (doc->ext_flags & HOEDOWN_EXT_NO_INTRA_EMPHASIS) {
-				if (i + 1 < size && isalnum(data[i + 1]))
-					continue;
-			}
+		if (is_emph_closer(doc, data, size, c, kind, i))
+			return i;
 
-			work = newbuf(doc, BUFFER_SPAN);
-			parse_inline(work, doc, data, i);
+		/* the closer of a double emphasis cannot overlap its opener */
+		if (kind == EMPH_DOUBLE)
+			i++;
+	}
 
-			if (doc->ext_flags & HOEDOWN_EXT_UNDERLINE && c == '_')
-				r = doc->md.underline(ob, work, doc->md.opaque);
-			else
-				r = doc->md.emphasis(ob, work, doc->md.opaque);
+	if (!run)
+		return 0;
 
-			popbuf(doc, BUFFER_SPAN);
-			return r ? i + 1 : 0;
+	if (!dead) {
+		hoedown_buffer *marks = newbuf(doc, BUFFER_INLINE);
+
+		if (hoedown_buffer_grow(marks, run->size) != HOEDOWN_BUF_OK) {
+			popbuf(doc, BUFFER_INLINE);
+			return 0;
 		}
+
+		memset(marks->data, 0x0, run->size);
+		marks->size = run->size;
+		run->emph_dead = marks;
+		dead = marks->data + (data - run->data);
+	}
+
+	/* going through the same positions again to mark them */
+	i = start;
+	while (i < size) {
+		len = find_emph_char(doc, data + i, size - i, c);
+		if (!len)
+			break;
+		i += len;
+
+		if (dead[i] & kind)
+			break;
+		dead[i] |= kind;
+
+		if (kind == EMPH_DOUBLE)
+			i++;
 	}
 
 	return 0;
 }
 
+/* parse_emph1 • parsing single emphase */
+/* closed by a symbol not preceded by whitespace and not followed by symbol */
+static size_t
+parse_emph1(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, uint8_t c)
+{
+	size_t i = 0;
+	hoedown_buffer *work = 0;
+	int r;
+
+	/* skipping one symbol if coming from emph3 */
+	if (size > 1 && data[0] == c && data[1] == c) i = 1;
+
+	i = find_emph_closer(doc, data, size, c, EMPH_SINGLE, i);
+	if (!i)
+		return 0;
+
+	work = newbuf(doc, BUFFER_SPAN);
+	parse_inline(work, doc, data, i);
+
+	if (doc->ext_flags & HOEDOWN_EXT_UNDERLINE && c == '_')
+		r = doc->md.underline(ob, work, doc->md.opaque);
+	else
+		r = doc->md.emphasis(ob, work, doc->md.opaque);
+
+	popbuf(doc, BUFFER_SPAN);
+	return r ? i + 1 : 0;
+}
+
 /* parse_emph2 • parsing single emphase */
 static size_t
 parse_emph2(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, uint8_t c)
 {
-	size_t i = 0, len;
+	size_t i;
 	hoedown_buffer *work = 0;
 	int r;
 
-	while (i < size) {
-		len = find_emph_char(data + i, size - i, c);
-		if (!len) return 0;
-		i += len;
+	i = find_emph_closer(doc, data, size, c, EMPH_DOUBLE, 0);
+	if (!i)
+		return 0;
 
-		if (i + 1 < size && data[i] == c && data[i + 1] == c && i && !_isspace(data[i - 1])) {
-			work = newbuf(doc, BUFFER_SPAN);
-			parse_inline(work, doc, data, i);
+	work = newbuf(doc, BUFFER_SPAN);
+	parse_inline(work, doc, data, i);
 
-			if (c == '~')
-				r = doc->md.strikethrough(ob, work, doc->md.opaque);
-			else if (c == '=')
-				r = doc->md.highlight(ob, work, doc->md.opaque);
-			else
-				r = doc->md.double_emphasis(ob, work, doc->md.opaque);
+	if (c == '~')
+		r = doc->md.strikethrough(ob, work, doc->md.opaque);
+	else if (c == '=')
+		r = doc->md.highlight(ob, work, doc->md.opaque);
+	else
+		r = doc->md.double_emphasis(ob, work, doc->md.opaque);
 
-			popbuf(doc, BUFFER_SPAN);
-			return r ? i + 2 : 0;
-		}
-		i++;
-	}
-	return 0;
+	popbuf(doc, BUFFER_SPAN);
+	return r ? i + 2 : 0;
 }
 
 /* parse_emph3 • parsing single emphase */
@@ -634,41 +1074,34 @@ parse_emph2(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t siz
 static size_t
 parse_emph3(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, uint8_t c)
 {
-	size_t i = 0, len;
+	size_t i, len;
 	int r;
 
-	while (i < size) {
-		len = find_emph_char(data + i, size - i, c);
-		if (!len) return 0;
-		i += len;
-
-		/* skip whitespace preceded symbols */
-		if (data[i] != c || _isspace(data[i - 1]))
-			continue;
+	i = find_emph_closer(doc, data, size, c, EMPH_TRIPLE, 0);
+	if (!i)
+		return 0;
 
-		if (i + 2 < size && data[i + 1] == c && data[i + 2] == c && doc->md.triple_emphasis) {
-			/* triple symbol found */
-			hoedown_buffer *work = newbuf(doc, BUFFER_SPAN);
+	if (i + 2 < size && data[i + 1] == c && data[i + 2] == c && doc->md.triple_emphasis) {
+		/* triple symbol found */
+		hoedown_buffer *work = newbuf(doc, BUFFER_SPAN);
 
-			parse_inline(work, doc, data, i);
-			r = doc->md.triple_emphasis(ob, work, doc->md.opaque);
-			popbuf(doc, BUFFER_SPAN);
-			return r ? i + 3 : 0;
+		parse_inline(work, doc, data, i);
+		r = doc->md.triple_emphasis(ob, work, doc->md.opaque);
+		popbuf(doc, BUFFER_SPAN);
+		return r ? i + 3 : 0;
 
-		} else if (i + 1 < size && data[i + 1] == c) {
-			/* double symbol found, handing over to emph1 */
-			len = parse_emph1(ob, doc, data - 2, size + 2, c);
-			if (!len) return 0;
-			else return len - 2;
+	} else if (i + 1 < size && data[i + 1] == c) {
+		/* double symbol found, handing over to emph1 */
+		len = parse_emph1(ob, doc, data - 2, size + 2, c);
+		if (!len) return 0;
+		else return len - 2;
 
-		} else {
-			/* single symbol found, handing over to emph2 */
-			len = parse_emph2(ob, doc, data - 1, size + 1, c);
-			if (!len) return 0;
-			else return len - 1;
-		}
+	} else {
+		/* single symbol found, handing over to emph2 */
+		len = parse_emph2(ob, doc, data - 1, size + 1, c);
+		if (!len) return 0;
+		else return len - 1;
 	}
-	return 0;
 }
 
 /* char_emphasis • single and double emphasis parsing */
@@ -706,43 +1139,158 @@ char_emphasis(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t o
 		return ret + 3;
 	}
 
-	return 0;
-}
-
-
-/* char_linebreak • '\n' preceded by two spaces (assuming linebreak != 0) */
-static size_t
-char_linebreak(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
-{
-	if (offset < 2 || data[-1] != ' ' || data[-2] != ' ')
-		return 0;
+	return 0;
+}
+
+
+/* char_linebreak • '\n' preceded by two spaces (assuming linebreak != 0) */
+static size_t
+char_linebreak(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
+{
+	if (offset < 2 || data[-1] != ' ' || data[-2] != ' ')
+		return 0;
+
+	/* removing the last space from ob and rendering */
+	while (ob->size && ob->data[ob->size - 1] == ' ')
+		ob->size--;
+
+	return doc->md.linebreak(ob, doc->md.opaque) ? 1 : 0;
+}
+
+
+/* lookup_closer • closer of the delimiter at pos, found with a cursor since
+ * the openers of a run are looked up in order */
+static size_t
+lookup_closer(hoedown_buffer *index, size_t *cursor, size_t pos)
+{
+	struct closer *closers = (struct closer *)index->data;
+
+	/* rewinding if they were not */
+	if (closers[*cursor].pos > pos)
+		*cursor = 0;
+
+	while (closers[*cursor].pos < pos)
+		(*cursor)++;
+
+	return closers[*cursor].closer;
+}
+
+/* index_code_closers • lists the backticks of the inline run with their
+ * closers, going from right to left while keeping the start of the nearest
+ * run of each length or more */
+static hoedown_buffer *
+index_code_closers(hoedown_document *doc, struct inline_run *run)
+{
+	hoedown_buffer *index = newbuf(doc, BUFFER_INLINE), *nearest;
+	struct closer *closers;
+	const uint8_t *tick;
+	size_t beg = 0, end, count, max_len = 0, *starts, i, len;
+
+	/* listing the backticks */
+	while ((tick = memchr(run->data + beg, '`', run->size - beg)) != NULL) {
+		beg = tick - run->data;
+		end = beg;
+		while (end < run->size && run->data[end] == '`')
+			end++;
+
+		if (hoedown_buffer_grow(index, index->size + (end - beg) * sizeof(struct closer)) != HOEDOWN_BUF_OK) {
+			popbuf(doc, BUFFER_INLINE);
+			return NULL;
+		}
+
+		closers = (struct closer *)(index->data + index->size);
+		for (i = 0; i < end - beg; i++)
+			closers[i].pos = beg + i;
+
+		index->size += (end - beg) * sizeof(struct closer);
+		if (end - beg > max_len)
+			max_len = end - beg;
+
+		beg = end;
+	}
+
+	nearest = newbuf(doc, BUFFER_INLINE);
+	if (hoedown_buffer_grow(nearest, (max_len + 1) * sizeof(size_t)) != HOEDOWN_BUF_OK) {
+		popbuf(doc, BUFFER_INLINE);
+		popbuf(doc, BUFFER_INLINE);
+		return NULL;
+	}
+
+	starts = (size_t *)nearest->data;
+	for (len = 0; len <= max_len; len++)
+		starts[len] = NO_CLOSER;
+
+	closers = (struct closer *)index->data;
+	count = index->size / sizeof(struct closer);
+
+	while (count > 0) {
+		/* the run ending with closers[count - 1] */
+		end = closers[count - 1].pos + 1;
+		i = count - 1;
+		while (i > 0 && closers[i - 1].pos + 1 == closers[i].pos)
+			i--;
+		beg = closers[i].pos;
+
+		for (; i < count; i++)
+			closers[i].closer = starts[end - closers[i].pos];
+
+		for (len = 1; len <= end - beg; len++)
+			starts[len] = beg;
+
+		count -= end - beg;
+	}
+
+	popbuf(doc, BUFFER_INLINE);
+	return index;
+}
+
+/* find_code_closer • end of the closing delimiter of a code span opened by
+ * nb backticks, 0 if there is none; once two searches went to the end of the
+ * inline run without a match, it is indexed rather than scanned again */
+static size_t
+find_code_closer(hoedown_document *doc, uint8_t *data, size_t size, size_t nb)
+{
+	struct inline_run *run = doc->run;
+	size_t end, i = 0, pos;
+
+	if (!run || data + size != run->data + run->size)
+		run = NULL;
+
+	if (run && run->code_closers) {
+		pos = data - run->data;
+		end = lookup_closer(run->code_closers, &run->code_cursor, pos);
+
+		return end == NO_CLOSER ? 0 : end - pos + nb;
+	}
+
+	/* finding the next delimiter */
+	for (end = nb; end < size && i < nb; end++) {
+		if (data[end] == '`') i++;
+		else i = 0;
+	}
+
+	if (i < nb && end >= size) {
+		if (run && ++run->code_misses >= 2)
+			run->code_closers = index_code_closers(doc, run);
 
-	/* removing the last space from ob and rendering */
-	while (ob->size && ob->data[ob->size - 1] == ' ')
-		ob->size--;
+		return 0; /* no matching delimiter */
+	}
 
-	return doc->md.linebreak(ob, doc->md.opaque) ? 1 : 0;
+	return end;
 }
 
-
 /* char_codespan • '`' parsing a code span (assuming codespan != 0) */
 static size_t
 char_codespan(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
 {
-	size_t end, nb = 0, i, f_begin, f_end;
+	size_t end, nb = 0, f_begin, f_end;
 
 	/* counting the number of backticks in the delimiter */
 	while (nb < size && data[nb] == '`')
 		nb++;
 
-	/* finding the next delimiter */
-	i = 0;
-	for (end = nb; end < size && i < nb; end++) {
-		if (data[end] == '`') i++;
-		else i = 0;
-	}
-
-	if (i < nb && end >= size)
+	end = find_code_closer(doc, data, size, nb);
+	if (!end)
 		return 0; /* no matching delimiter */
 
 	/* trimming outside whitespaces */
@@ -868,7 +1416,7 @@ static size_t
 char_langle_tag(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
 {
 	enum hoedown_autolink altype = HOEDOWN_AUTOLINK_NONE;
-	size_t end = tag_length(data, size, &altype);
+	size_t end = tag_length(doc->run, data, size, &altype);
 	hoedown_buffer work = { data, end, 0, 0 };
 	int ret = 0;
 
@@ -961,6 +1509,83 @@ char_autolink_url(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size
 	return link_len;
 }
 
+/* index_link_closers • pairs the brackets of the inline run as char_link
+ * does, where one preceded by a backslash only counts as an opener; the
+ * closer of the '[' at o is the first ']' after it where the bracket depth
+ * goes one below its own, found right to left from the nearest ']' at
+ * each depth */
+static hoedown_buffer *
+index_link_closers(hoedown_document *doc, struct inline_run *run)
+{
+	hoedown_buffer *index = newbuf(doc, BUFFER_INLINE), *nearest;
+	struct closer *closers;
+	size_t i, count = 0, nb_close = 0, *depths, *ends;
+	long depth = 0;
+
+	/* listing the openers with the depth after each bracket, kept in
+	 * closer until the second pass */
+	for (i = 0; i < run->size; i++) {
+		int counts = i == 0 || run->data[i - 1] != '\\';
+
+		if (run->data[i] == ']' && counts) {
+			depth--;
+			nb_close++;
+		}
+
+		else if (run->data[i] == '[') {
+			if (counts)
+				depth++;
+
+			if (hoedown_buffer_grow(index, index->size + sizeof(struct closer)) != HOEDOWN_BUF_OK) {
+				popbuf(doc, BUFFER_INLINE);
+				return NULL;
+			}
+
+			closers = (struct closer *)(index->data + index->size);
+			closers->pos = i;
+			closers->closer = (size_t)depth;
+			index->size += sizeof(struct closer);
+		}
+	}
+
+	count = index->size / sizeof(struct closer);
+	closers = (struct closer *)index->data;
+
+	/* depths go from -nb_close to count, shifted by nb_close */
+	nearest = newbuf(doc, BUFFER_INLINE);
+	if (hoedown_buffer_grow(nearest, (nb_close + count + 1) * sizeof(size_t)) != HOEDOWN_BUF_OK) {
+		popbuf(doc, BUFFER_INLINE);
+		popbuf(doc, BUFFER_INLINE);
+		return NULL;
+	}
+
+	ends = (size_t *)nearest->data;
+	for (i = 0; i <= nb_close + count; i++)
+		ends[i] = NO_CLOSER;
+
+	depths = ends + nb_close;
+	i = run->size;
+	while (i-- > 0) {
+		if (run->data[i] == ']' && (i == 0 || run->data[i - 1] != '\\')) {
+			depths[depth] = i;
+			depth++;
+		}
+
+		else if (run->data[i] == '[') {
+			count--;
+			depth = (long)closers[count].closer;
+			closers[count].closer = depth > -(long)nb_close ? depths[depth - 1] : NO_CLOSER;
+
+			/* the depth before this bracket */
+			if (i == 0 || run->data[i - 1] != '\\')
+				depth--;
+		}
+	}
+
+	popbuf(doc, BUFFER_INLINE);
+	return index;
+}
+
 /* char_link • '[': parsing a link or an image */
 static size_t
 char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
@@ -972,29 +1597,40 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 	hoedown_buffer *title = 0;
 	hoedown_buffer *u_link = 0;
 	size_t org_work_size = doc->work_bufs[BUFFER_SPAN].size;
-	int text_has_nl = 0, ret = 0;
+	struct inline_run *run = doc->run;
+	int ret = 0;
 	int in_title = 0, qtype = 0;
 
 	/* checking whether the correct renderer exists */
 	if ((is_img && !doc->md.image) || (!is_img && !doc->md.link))
 		goto cleanup;
 
-	/* looking for the matching closing bracket */
-	for (level = 1; i < size; i++) {
-		if (data[i] == '\n')
-			text_has_nl = 1;
+	if (!run || data + size != run->data + run->size)
+		run = NULL;
 
-		else if (data[i - 1] == '\\')
-			continue;
+	/* looking for the matching closing bracket */
+	if (run && run->link_closers) {
+		i = lookup_closer(run->link_closers, &run->link_cursor, data - run->data);
+		i = i == NO_CLOSER ? size : i - (data - run->data);
+	} else {
+		for (level = 1; i < size; i++) {
+			if (data[i] == '\n' || data[i - 1] == '\\')
+				continue;
 
-		else if (data[i] == '[')
-			level++;
+			else if (data[i] == '[')
+				level++;
 
-		else if (data[i] == ']') {
-			level--;
-			if (level <= 0)
-				break;
+			else if (data[i] == ']') {
+				level--;
+				if (level <= 0)
+					break;
+			}
 		}
+
+		/* unmatched and nested brackets get scanned again by later
+		 * openers, so the run is indexed once that adds up to its size */
+		if (run && (run->link_scanned += i) > run->size)
+			run->link_closers = index_link_closers(doc, run);
 	}
 
 	if (i >= size)
@@ -1018,7 +1654,7 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 		
 		/* mark footnote used */
 		if (fr && !fr->is_used) {
-			if(!add_footnote_ref(&doc->footnotes_used, fr))
+			if(!add_footnote_ref(&doc->arena, &doc->footnotes_used, fr))
 				goto cleanup;
 			fr->is_used = 1;
 			fr->num = doc->footnotes_used.count;
@@ -1048,6 +1684,11 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 
 		link_b = i;
 
+		/* every inline link ends with a ')', there is no need to go
+		 * through the rest of the run for each '[' without one */
+		if (find_next_byte(run, data, i, size, ')') >= size)
+			goto cleanup;
+
 		/* looking for link end: ' " ) */
 		/* Count the number of open parenthesis */
 		nb_p = 0;
@@ -1125,13 +1766,16 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 		/* looking for the id */
 		i++;
 		link_b = i;
-		while (i < size && data[i] != ']') i++;
+		i = find_next_byte(run, data, i, size, ']');
 		if (i >= size) goto cleanup;
 		link_e = i;
 
 		/* finding the link_ref */
 		if (link_b == link_e) {
-			if (text_has_nl) {
+			if (!link_ref_fits(doc, txt_e - 1))
+				goto cleanup;
+
+			if (memchr(data + 1, '\n', txt_e - 1)) {
 				hoedown_buffer *b = newbuf(doc, BUFFER_SPAN);
 				size_t j;
 
@@ -1153,7 +1797,7 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 			id.size = link_e - link_b;
 		}
 
-		lr = find_link_ref(doc->refs, id.data, id.size);
+		lr = lookup_link_ref(doc, id.data, id.size);
 		if (!lr)
 			goto cleanup;
 
@@ -1169,7 +1813,10 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 		struct link_ref *lr;
 
 		/* crafting the id */
-		if (text_has_nl) {
+		if (!link_ref_fits(doc, txt_e - 1))
+			goto cleanup;
+
+		if (memchr(data + 1, '\n', txt_e - 1)) {
 			hoedown_buffer *b = newbuf(doc, BUFFER_SPAN);
 			size_t j;
 
@@ -1188,7 +1835,7 @@ char_link(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offse
 		}
 
 		/* finding the link_ref */
-		lr = find_link_ref(doc->refs, id.data, id.size);
+		lr = lookup_link_ref(doc, id.data, id.size);
 		if (!lr)
 			goto cleanup;
 
@@ -1238,7 +1885,7 @@ cleanup:
 static size_t
 char_superscript(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t offset, size_t size)
 {
-	size_t sup_start, sup_len;
+	size_t sup_start, sup_len, esc;
 	hoedown_buffer *sup;
 
 	if (!doc->md.superscript)
@@ -1248,12 +1895,15 @@ char_superscript(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_
 		return 0;
 
 	if (data[1] == '(') {
-		sup_start = sup_len = 2;
+		sup_start = 2;
 
-		while (sup_len < size && data[sup_len] != ')' && data[sup_len - 1] != '\\')
-			sup_len++;
+		/* up to the first ')', or the byte after the first backslash */
+		sup_len = find_next_byte(doc->run, data, 2, size, ')');
+		esc = find_next_byte(doc->run, data, 2, size, '\\');
+		if (esc + 1 < sup_len)
+			sup_len = esc + 1;
 
-		if (sup_len == size)
+		if (sup_len >= size)
 			return 0;
 	} else {
 		sup_start = sup_len = 1;
@@ -1453,16 +2103,6 @@ prefix_quote(uint8_t *data, size_t size)
 	return 0;
 }
 
-/* prefix_code • returns prefix length for block code*/
-static size_t
-prefix_code(uint8_t *data, size_t size)
-{
-	if (size > 3 && data[0] == ' ' && data[1] == ' '
-		&& data[2] == ' ' && data[3] == ' ') return 4;
-
-	return 0;
-}
-
 /* prefix_oli • returns ordered list item prefix */
 static size_t
 prefix_oli(uint8_t *data, size_t size)
@@ -1509,6 +2149,83 @@ prefix_uli(uint8_t *data, size_t size)
 	return i + 2;
 }
 
+/* scan_line • fills in the line starting at data and ending with its
+ * newline, or at end */
+static void
+scan_line(struct line *line, uint8_t *data, uint8_t *end)
+{
+	uint8_t *i = data, *nl;
+
+	while (i < end && *i == ' ')
+		i++;
+
+	line->data = data;
+	line->indent = i - data < UINT8_MAX ? (uint8_t)(i - data) : UINT8_MAX;
+	line->first = i < end ? *i : 0;
+	line->blank = i >= end || *i == '\n';
+
+	nl = i < end ? memchr(i, '\n', end - i) : NULL;
+	line->size = (nl ? nl + 1 : end) - data;
+}
+
+/* index_lines • splits the text into lines, in a buffer that must be
+ * released with popbuf(doc, BUFFER_LINES); NULL if memory ran out */
+static hoedown_buffer *
+index_lines(hoedown_document *doc, uint8_t *data, size_t size)
+{
+	hoedown_buffer *index = newbuf(doc, BUFFER_LINES);
+	struct line *line;
+	size_t beg = 0;
+
+	while (beg < size) {
+		if (hoedown_buffer_grow(index, index->size + sizeof(struct line)) != HOEDOWN_BUF_OK) {
+			popbuf(doc, BUFFER_LINES);
+			return NULL;
+		}
+
+		line = (struct line *)(index->data + index->size);
+		scan_line(line, data + beg, data + size);
+
+		index->size += sizeof(struct line);
+		beg += line->size;
+	}
+
+	return index;
+}
+
+/* seek_line • returns the line holding pos, rescanning it from pos on
+ * when a block ended halfway through it */
+static struct line *
+seek_line(struct line *line, uint8_t *pos, uint8_t *end)
+{
+	while (line->data + line->size <= pos)
+		line++;
+
+	if (line->data != pos)
+		scan_line(line, pos, end);
+
+	return line;
+}
+
+/* line_blocks • the MD_BLOCK_ constructs that may start on a line once pre
+ * columns of indentation have been stripped; the matching prefix_ or is_
+ * function is never true for the others */
+static unsigned int
+line_blocks(hoedown_document *doc, struct line *line, size_t pre)
+{
+	unsigned int blocks;
+
+	if (line->indent - pre >= 4)
+		return 0;
+
+	blocks = doc->block_char[line->first];
+
+	/* these must start right at the beginning of the line */
+	if (line->indent > pre)
+		blocks &= ~(MD_BLOCK_ATXHEADER | MD_BLOCK_SETEXT | MD_BLOCK_HTML);
+
+	return blocks;
+}
 
 /* parse_block • parsing of one block, returning next uint8_t to parse */
 static void parse_block(hoedown_buffer *ob, hoedown_document *doc,
@@ -1517,7 +2234,7 @@ static void parse_block(hoedown_buffer *ob, hoedown_document *doc,
 
 /* parse_blockquote • handles parsing of a blockquote fragment */
 static size_t
-parse_blockquote(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size)
+parse_blockquote(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, struct line *line)
 {
 	size_t beg, end = 0, pre, work_size = 0;
 	uint8_t *work_data = 0;
@@ -1526,7 +2243,8 @@ parse_blockquote(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_
 	out = newbuf(doc, BUFFER_BLOCK);
 	beg = 0;
 	while (beg < size) {
-		for (end = beg + 1; end < size && data[end - 1] != '\n'; end++);
+		line = seek_line(line, data + beg, data + size);
+		end = line->data + line->size - data;
 
 		pre = prefix_quote(data + beg, end - beg);
 
@@ -1534,9 +2252,8 @@ parse_blockquote(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_
 			beg += pre; /* skipping prefix */
 
 		/* empty line followed by non-quote line */
-		else if (is_empty(data + beg, end - beg) &&
-				(end >= size || (prefix_quote(data + end, size - end) == 0 &&
-				!is_empty(data + end, size - end))))
+		else if (line->blank &&
+				(end >= size || (!(line_blocks(doc, line + 1, 0) & MD_BLOCK_QUOTE) && !line[1].blank)))
 			break;
 
 		if (beg < end) { /* copy into the in-place working buffer */
@@ -1562,24 +2279,29 @@ parse_htmlblock(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 
 /* parse_blockquote • handles parsing of a regular paragraph */
 static size_t
-parse_paragraph(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size)
+parse_paragraph(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, struct line *line)
 {
 	size_t i = 0, end = 0;
+	unsigned int blocks;
 	int level = 0;
 	hoedown_buffer work = { data, 0, 0, 0 };
 
 	while (i < size) {
-		for (end = i + 1; end < size && data[end - 1] != '\n'; end++) /* empty */;
+		line = seek_line(line, data + i, data + size);
+		end = line->data + line->size - data;
 
-		if (is_empty(data + i, size - i))
+		if (line->blank)
 			break;
 
-		if ((level = is_headerline(data + i, size - i)) != 0)
+		blocks = line_blocks(doc, line, 0);
+
+		if ((blocks & MD_BLOCK_SETEXT) &&
+			(level = is_headerline(data + i, size - i)) != 0)
 			break;
 
-		if (is_atxheader(doc, data + i, size - i) ||
-			is_hrule(data + i, size - i) ||
-			prefix_quote(data + i, size - i)) {
+		if (((blocks & MD_BLOCK_ATXHEADER) && is_atxheader(doc, data + i, size - i)) ||
+			((blocks & MD_BLOCK_HRULE) && is_hrule(data + i, size - i)) ||
+			(blocks & MD_BLOCK_QUOTE)) {
 			end = i;
 			break;
 		}
@@ -1594,21 +2316,21 @@ parse_paragraph(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 		 * here
 		 */
 		if ((doc->ext_flags & HOEDOWN_EXT_LAX_SPACING) && !isalnum(data[i])) {
-			if (prefix_oli(data + i, size - i) ||
-				prefix_uli(data + i, size - i)) {
+			if (((blocks & MD_BLOCK_OLI) && prefix_oli(data + i, size - i)) ||
+				((blocks & MD_BLOCK_ULI) && prefix_uli(data + i, size - i))) {
 				end = i;
 				break;
 			}
 
 			/* see if an html block starts here */
-			if (data[i] == '<' && doc->md.blockhtml &&
+			if ((blocks & MD_BLOCK_HTML) &&
 				parse_htmlblock(ob, doc, data + i, size - i, 0)) {
 				end = i;
 				break;
 			}
 
 			/* see if a code fence starts here */
-			if ((doc->ext_flags & HOEDOWN_EXT_FENCED_CODE) != 0 &&
+			if ((blocks & MD_BLOCK_FENCE) &&
 				is_codefence(data + i, size - i, NULL, NULL)) {
 				end = i;
 				break;
@@ -1696,6 +2418,11 @@ parse_fencedcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_
 		    is_empty(data + (line_start+w), i - (line_start+w)))
 			break;
 	}
+	/* an unclosed fence runs to the end of the data, which does not
+	 * have to end with a newline inside a footnote */
+	if (line_start > size)
+		line_start = i = size;
+
 	text.data = data + text_start;
 	text.size = line_start - text_start;
 
@@ -1703,12 +2430,12 @@ parse_fencedcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_
 	if (doc->md.blockcode)
 		doc->md.blockcode(ob, text.size ? &text : NULL, lang.size ? &lang : NULL, doc->md.opaque);
 
-	if (data[i] == '\n') i++;
+	if (i < size && data[i] == '\n') i++;
 	return i;
 }
 
 static size_t
-parse_blockcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size)
+parse_blockcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, struct line *line)
 {
 	size_t beg, end, pre;
 	hoedown_buffer *work = 0;
@@ -1717,19 +2444,20 @@ parse_blockcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 
 	beg = 0;
 	while (beg < size) {
-		for (end = beg + 1; end < size && data[end - 1] != '\n'; end++) {};
-		pre = prefix_code(data + beg, end - beg);
+		line = seek_line(line, data + beg, data + size);
+		end = line->data + line->size - data;
+		pre = line->indent >= 4 ? 4 : 0;
 
 		if (pre)
 			beg += pre; /* skipping prefix */
-		else if (!is_empty(data + beg, end - beg))
+		else if (!line->blank)
 			/* non-empty non-prefixed line breaks the pre */
 			break;
 
 		if (beg < end) {
 			/* verbatim copy to the working buffer,
 				escaping entities */
-			if (is_empty(data + beg, end - beg))
+			if (line->blank)
 				hoedown_buffer_putc(work, '\n');
 			else hoedown_buffer_put(work, data + beg, end - beg);
 		}
@@ -1751,15 +2479,15 @@ parse_blockcode(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 /* parse_listitem • parsing of a single list item */
 /*	assuming initial prefix is already removed */
 static size_t
-parse_listitem(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, int *flags)
+parse_listitem(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, int *flags, struct line *line)
 {
 	hoedown_buffer *work = 0, *inter = 0;
 	size_t beg = 0, end, pre, sublist = 0, orgpre = 0, i;
+	unsigned int blocks;
 	int in_empty = 0, has_inside_empty = 0, in_fence = 0;
 
 	/* keeping track of the first indentation prefix */
-	while (orgpre < 3 && orgpre < size && data[orgpre] == ' ')
-		orgpre++;
+	orgpre = line->indent < 3 ? line->indent : 3;
 
 	beg = prefix_uli(data, size);
 	if (!beg)
@@ -1769,9 +2497,7 @@ parse_listitem(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 		return 0;
 
 	/* skipping to the beginning of the following line */
-	end = beg;
-	while (end < size && data[end - 1] != '\n')
-		end++;
+	end = line->data + line->size - data;
 
 	/* getting working buffers */
 	work = newbuf(doc, BUFFER_SPAN);
@@ -1785,35 +2511,33 @@ parse_listitem(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 	while (beg < size) {
 		size_t has_next_uli = 0, has_next_oli = 0;
 
-		end++;
-
-		while (end < size && data[end - 1] != '\n')
-			end++;
+		line = seek_line(line, data + beg, data + size);
+		end = line->data + line->size - data;
 
 		/* process an empty line */
-		if (is_empty(data + beg, end - beg)) {
+		if (line->blank) {
 			in_empty = 1;
 			beg = end;
 			continue;
 		}
 
 		/* calculating the indentation */
-		i = 0;
-		while (i < 4 && beg + i < end && data[beg + i] == ' ')
-			i++;
+		i = line->indent < 4 ? line->indent : 4;
 
 		pre = i;
+		blocks = line_blocks(doc, line, i);
 
-		if (doc->ext_flags & HOEDOWN_EXT_FENCED_CODE) {
-			if (is_codefence(data + beg + i, end - beg - i, NULL, NULL))
-				in_fence = !in_fence;
-		}
+		if ((blocks & MD_BLOCK_FENCE) &&
+			is_codefence(data + beg + i, end - beg - i, NULL, NULL))
+			in_fence = !in_fence;
 
 		/* Only check for new list items if we are **not** inside
 		 * a fenced code block */
 		if (!in_fence) {
-			has_next_uli = prefix_uli(data + beg + i, end - beg - i);
-			has_next_oli = prefix_oli(data + beg + i, end - beg - i);
+			if (blocks & MD_BLOCK_ULI)
+				has_next_uli = prefix_uli(data + beg + i, end - beg - i);
+			if (blocks & MD_BLOCK_OLI)
+				has_next_oli = prefix_oli(data + beg + i, end - beg - i);
 		}
 
 		/* checking for ul/ol switch */
@@ -1888,7 +2612,7 @@ parse_listitem(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 
 /* parse_list • parsing ordered or unordered list block */
 static size_t
-parse_list(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, int flags)
+parse_list(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size, int flags, struct line *line)
 {
 	hoedown_buffer *work = 0;
 	size_t i = 0, j;
@@ -1896,7 +2620,8 @@ parse_list(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size
 	work = newbuf(doc, BUFFER_BLOCK);
 
 	while (i < size) {
-		j = parse_listitem(work, doc, data + i, size - i, &flags);
+		line = seek_line(line, data + i, data + size);
+		j = parse_listitem(work, doc, data + i, size - i, &flags, line);
 		i += j;
 
 		if (!j || (flags & HOEDOWN_LI_END))
@@ -2015,6 +2740,30 @@ htmlblock_end_tag(
 	return i + w;
 }
 
+/* html_end_tail • the tail of the block run known to hold no closer for tag
+ * past the first line of a block, or NULL when data does not end with it */
+static size_t *
+html_end_tail(struct block_run *run, const char *tag, const uint8_t *data, size_t size, int start_of_line)
+{
+	struct html_end *end;
+	size_t n;
+
+	if (!run || data + size != run->data + run->size)
+		return NULL;
+
+	for (n = 0; n < run->html_end_count; n++)
+		if (run->html_ends[n].tag == tag)
+			return &run->html_ends[n].tail[start_of_line];
+
+	if (run->html_end_count == HTML_END_TAGS)
+		return NULL;
+
+	end = &run->html_ends[run->html_end_count++];
+	end->tag = tag;
+	end->tail[0] = end->tail[1] = 0;
+	return &end->tail[start_of_line];
+}
+
 static size_t
 htmlblock_end(const char *curtag,
 	hoedown_document *doc,
@@ -2023,16 +2772,28 @@ htmlblock_end(const char *curtag,
 	int start_of_line)
 {
 	size_t tag_size = strlen(curtag);
-	size_t i = 1, end_tag;
-	int block_lines = 0;
-
-	while (i < size) {
-		i++;
-		while (i < size && !(data[i - 1] == '<' && data[i] == '/')) {
-			if (data[i] == '\n')
-				block_lines++;
+	size_t i = 1, end_tag, first_nl, limit = size;
+	size_t *tail;
+	uint8_t *found;
+
+	found = size > 2 ? memchr(data + 2, '\n', size - 2) : NULL;
+	first_nl = found ? (size_t)(found - data) : size;
+
+	/* whether a closer counts past the first line does not depend on where
+	 * the block starts, so once a search has failed, the blocks whose first
+	 * line ends later only need their first line looked at */
+	tail = html_end_tail(doc->block, curtag, data, size, start_of_line);
+	if (tail && size - first_nl <= *tail)
+		limit = first_nl;
+
+	while (i + 1 < limit) {
+		found = memchr(data + i, '<', limit - 1 - i);
+		if (!found)
+			break;
 
-			i++;
+		i = found - data;
+		if (data[i + 1] != '/') {
+			i++; continue;
 		}
 
 		/* If we are only looking for unindented tags, skip the tag
@@ -2042,20 +2803,68 @@ htmlblock_end(const char *curtag,
 		 * initial line; in that case it still counts as a closing
 		 * tag
 		 */
-		if (start_of_line && block_lines > 0 && data[i - 2] != '\n')
-			continue;
+		if (start_of_line && i > first_nl && data[i - 1] != '\n') {
+			i += 2; continue;
+		}
 
-		if (i + 2 + tag_size >= size)
+		if (i + 3 + tag_size >= size)
 			break;
 
-		end_tag = htmlblock_end_tag(curtag, tag_size, doc, data + i - 1, size - i + 1);
+		end_tag = htmlblock_end_tag(curtag, tag_size, doc, data + i, size - i);
 		if (end_tag)
-			return i + end_tag - 1;
+			return i + end_tag;
+
+		i += 2;
 	}
 
+	if (tail && size - first_nl > *tail)
+		*tail = size - first_nl;
+
 	return 0;
 }
 
+/* find_block_text • offset of the first pat ('>' or "-->") at or after i in
+ * data, or size; like find_next_byte, the answer is kept when data ends with
+ * the block run */
+static size_t
+find_block_text(struct block_run *run, uint8_t *data, size_t i, size_t size, const char *pat)
+{
+	struct next_byte *cache = NULL;
+	size_t len = strlen(pat), j = i + len - 1, base = 0;
+	uint8_t *found;
+
+	if (run && data + size == run->data + run->size) {
+		cache = pat[0] == '>' ? &run->next_angle : &run->next_comment;
+		base = data - run->data;
+		if (cache->from <= base + i && base + i <= cache->at)
+			return cache->at - base;
+	}
+
+	/* looking for the last byte, which pat holds only once */
+	while (j < size) {
+		found = memchr(data + j, pat[len - 1], size - j);
+		if (!found) {
+			j = size;
+			break;
+		}
+
+		j = found - data;
+		if (memcmp(data + j + 1 - len, pat, len - 1) == 0)
+			break;
+
+		j++;
+	}
+
+	j = j < size ? j + 1 - len : size;
+
+	if (cache) {
+		cache->from = base + i;
+		cache->at = base + j;
+	}
+
+	return j;
+}
+
 
 /* parse_htmlblock • parsing of inline HTML block */
 static size_t
@@ -2069,11 +2878,12 @@ parse_htmlblock(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 	if (size < 2 || data[0] != '<')
 		return 0;
 
+	/* no block tag is anywhere near HTML_TAG_MAX bytes long */
 	i = 1;
-	while (i < size && data[i] != '>' && data[i] != ' ')
+	while (i < size && i <= HTML_TAG_MAX && data[i] != '>' && data[i] != ' ')
 		i++;
 
-	if (i < size)
+	if (i < size && i <= HTML_TAG_MAX)
 		curtag = hoedown_find_block_tag((char *)data + 1, (int)i - 1);
 
 	/* handling of special cases */
@@ -2081,12 +2891,7 @@ parse_htmlblock(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 
 		/* HTML comment, laxist form */
 		if (size > 5 && data[1] == '!' && data[2] == '-' && data[3] == '-') {
-			i = 5;
-
-			while (i < size && !(data[i - 2] == '-' && data[i - 1] == '-' && data[i] == '>'))
-				i++;
-
-			i++;
+			i = find_block_text(doc->block, data, 3, size, "-->") + 3;
 
 			if (i < size)
 				j = is_empty(data + i, size - i);
@@ -2101,9 +2906,7 @@ parse_htmlblock(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t
 
 		/* HR, which is the only self-closing block tag considered */
 		if (size > 4 && (data[1] == 'h' || data[1] == 'H') && (data[2] == 'r' || data[2] == 'R')) {
-			i = 3;
-			while (i < size && data[i] != '>')
-				i++;
+			i = find_block_text(doc->block, data, 3, size, ">");
 
 			if (i + 1 < size) {
 				i++;
@@ -2234,7 +3037,7 @@ parse_table_header(
 		return 0;
 
 	*columns = pipes + 1;
-	*column_data = calloc(*columns, sizeof(int));
+	*column_data = arena_alloc(&doc->arena, *columns * sizeof(int));
 
 	/* Parse the header underline */
 	i++;
@@ -2343,7 +3146,6 @@ parse_table(
 			doc->md.table(ob, header_work, body_work, doc->md.opaque);
 	}
 
-	free(col_data);
 	popbuf(doc, BUFFER_SPAN);
 	popbuf(doc, BUFFER_BLOCK);
 	return i;
@@ -2354,60 +3156,83 @@ static void
 parse_block(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t size)
 {
 	size_t beg, end, i;
+	unsigned int blocks;
 	uint8_t *txt_data;
+	hoedown_buffer *index;
+	struct line *line;
+	struct block_run run;
 	beg = 0;
 
 	if (doc->work_bufs[BUFFER_SPAN].size +
 		doc->work_bufs[BUFFER_BLOCK].size > doc->max_nesting)
 		return;
 
+	/* the block parsers look lines up here instead of scanning for them */
+	index = index_lines(doc, data, size);
+	if (!index)
+		return;
+
+	line = (struct line *)index->data;
+
+	run.data = data;
+	run.size = size;
+	run.html_end_count = 0;
+	run.next_angle.from = run.next_comment.from = 1;
+	run.next_angle.at = run.next_comment.at = 0;
+	run.parent = doc->block;
+	doc->block = &run;
+
 	while (beg < size) {
 		txt_data = data + beg;
 		end = size - beg;
+		line = seek_line(line, txt_data, data + size);
+		blocks = line_blocks(doc, line, 0);
 
-		if (is_atxheader(doc, txt_data, end))
+		if ((blocks & MD_BLOCK_ATXHEADER) && is_atxheader(doc, txt_data, end))
 			beg += parse_atxheader(ob, doc, txt_data, end);
 
-		else if (data[beg] == '<' && doc->md.blockhtml &&
+		else if ((blocks & MD_BLOCK_HTML) &&
 				(i = parse_htmlblock(ob, doc, txt_data, end, 1)) != 0)
 			beg += i;
 
-		else if ((i = is_empty(txt_data, end)) != 0)
-			beg += i;
+		else if (line->blank)
+			beg += line->size;
 
-		else if (is_hrule(txt_data, end)) {
+		else if ((blocks & MD_BLOCK_HRULE) && is_hrule(txt_data, end)) {
 			if (doc->md.hrule)
 				doc->md.hrule(ob, doc->md.opaque);
 
-			while (beg < size && data[beg] != '\n')
-				beg++;
-
-			beg++;
+			beg += line->size;
 		}
 
-		else if ((doc->ext_flags & HOEDOWN_EXT_FENCED_CODE) != 0 &&
+		else if ((blocks & MD_BLOCK_FENCE) &&
 			(i = parse_fencedcode(ob, doc, txt_data, end)) != 0)
 			beg += i;
 
+		/* a table header needs a pipe on its first line */
 		else if ((doc->ext_flags & HOEDOWN_EXT_TABLES) != 0 &&
+			memchr(txt_data, '|', line->size) &&
 			(i = parse_table(ob, doc, txt_data, end)) != 0)
 			beg += i;
 
-		else if (prefix_quote(txt_data, end))
-			beg += parse_blockquote(ob, doc, txt_data, end);
+		else if (blocks & MD_BLOCK_QUOTE)
+			beg += parse_blockquote(ob, doc, txt_data, end, line);
 
-		else if (!(doc->ext_flags & HOEDOWN_EXT_DISABLE_INDENTED_CODE) && prefix_code(txt_data, end))
-			beg += parse_blockcode(ob, doc, txt_data, end);
+		else if (!(doc->ext_flags & HOEDOWN_EXT_DISABLE_INDENTED_CODE) && line->indent >= 4)
+			beg += parse_blockcode(ob, doc, txt_data, end, line);
 
-		else if (prefix_uli(txt_data, end))
-			beg += parse_list(ob, doc, txt_data, end, 0);
+		else if ((blocks & MD_BLOCK_ULI) && prefix_uli(txt_data, end))
+			beg += parse_list(ob, doc, txt_data, end, 0, line);
 
-		else if (prefix_oli(txt_data, end))
-			beg += parse_list(ob, doc, txt_data, end, HOEDOWN_LIST_ORDERED);
+		else if ((blocks & MD_BLOCK_OLI) && prefix_oli(txt_data, end))
+			beg += parse_list(ob, doc, txt_data, end, HOEDOWN_LIST_ORDERED, line);
 
 		else
-			beg += parse_paragraph(ob, doc, txt_data, end);
+			beg += parse_paragraph(ob, doc, txt_data, end, line);
 	}
+
+	doc->block = run.parent;
+	popbuf(doc, BUFFER_LINES);
 }
 
 
@@ -2418,7 +3243,7 @@ parse_block(hoedown_buffer *ob, hoedown_document *doc, uint8_t *data, size_t siz
 
 /* is_footnote • returns whether a line is a footnote definition or not */
 static int
-is_footnote(const uint8_t *data, size_t beg, size_t end, size_t *last, struct footnote_list *list)
+is_footnote(const uint8_t *data, size_t beg, size_t end, size_t *last, hoedown_document *doc)
 {
 	size_t i = 0;
 	hoedown_buffer *contents = 0;
@@ -2453,7 +3278,7 @@ is_footnote(const uint8_t *data, size_t beg, size_t end, size_t *last, struct fo
 	i++;
 	
 	/* getting content buffer */
-	contents = hoedown_buffer_new(64);
+	contents = newbuf(doc, BUFFER_BLOCK);
 	
 	start = i;
 	
@@ -2506,16 +3331,18 @@ is_footnote(const uint8_t *data, size_t beg, size_t end, size_t *last, struct fo
 	if (last)
 		*last = start;
 	
-	if (list) {
+	{
 		struct footnote_ref *ref;
-		ref = create_footnote_ref(list, data + id_offset, id_end - id_offset);
-		if (!ref)
+		ref = create_footnote_ref(&doc->arena, data + id_offset, id_end - id_offset);
+		if (ref)
+			ref->contents = arena_buffer(&doc->arena, contents->data, contents->size);
+		popbuf(doc, BUFFER_BLOCK);
+		if (!ref || !ref->contents)
 			return 0;
-		if (!add_footnote_ref(list, ref)) {
-			free_footnote_ref(ref);
+		/* the first definition of a footnote wins */
+		if (!find_ref(&doc->footnotes_found, ref->key.name, ref->key.size) &&
+			!add_ref(&doc->arena, &doc->footnotes_found, &ref->key))
 			return 0;
-		}
-		ref->contents = contents;
 	}
 	
 	return 1;
@@ -2523,7 +3350,7 @@ is_footnote(const uint8_t *data, size_t beg, size_t end, size_t *last, struct fo
 
 /* is_ref • returns whether a line is a reference or not */
 static int
-is_ref(const uint8_t *data, size_t beg, size_t end, size_t *last, struct link_ref **refs)
+is_ref(const uint8_t *data, size_t beg, size_t end, size_t *last, struct arena *arena, struct ref_table *refs)
 {
 /*	int n; */
 	size_t i = 0;
@@ -2619,22 +3446,30 @@ is_ref(const uint8_t *data, size_t beg, size_t end, size_t *last, struct link_re
 	if (refs) {
 		struct link_ref *ref;
 
-		ref = add_link_ref(refs, data + id_offset, id_end - id_offset);
+		ref = add_link_ref(arena, refs, data + id_offset, id_end - id_offset);
 		if (!ref)
 			return 0;
 
-		ref->link = hoedown_buffer_new(link_end - link_offset);
-		hoedown_buffer_put(ref->link, data + link_offset, link_end - link_offset);
+		ref->link = arena_buffer(arena, data + link_offset, link_end - link_offset);
 
-		if (title_end > title_offset) {
-			ref->title = hoedown_buffer_new(title_end - title_offset);
-			hoedown_buffer_put(ref->title, data + title_offset, title_end - title_offset);
-		}
+		if (title_end > title_offset)
+			ref->title = arena_buffer(arena, data + title_offset, title_end - title_offset);
 	}
 
 	return 1;
 }
 
+/* copy_text • appends unchanged lines to the text of the first pass, making
+ * room for the whole document on the first copy */
+static void
+copy_text(hoedown_buffer *text, const uint8_t *data, size_t size, size_t doc_size)
+{
+	if (!text->asize)
+		hoedown_buffer_grow(text, doc_size);
+
+	hoedown_buffer_put(text, data, size);
+}
+
 static void expand_tabs(hoedown_buffer *ob, const uint8_t *line, size_t size)
 {
 	size_t  i = 0, tab = 0;
@@ -2671,10 +3506,11 @@ hoedown_document_new(
 	size_t max_nesting)
 {
 	hoedown_document *doc = NULL;
+	int i;
 
 	assert(max_nesting > 0 && renderer);
 
-	doc = malloc(sizeof(hoedown_document));
+	doc = hoedown_malloc(sizeof(hoedown_document));
 	if (!doc)
 		return NULL;
 
@@ -2682,6 +3518,13 @@ hoedown_document_new(
 
 	hoedown_stack_new(&doc->work_bufs[BUFFER_BLOCK], 4);
 	hoedown_stack_new(&doc->work_bufs[BUFFER_SPAN], 8);
+	hoedown_stack_new(&doc->work_bufs[BUFFER_LINES], 4);
+	hoedown_stack_new(&doc->work_bufs[BUFFER_INLINE], 4);
+
+	doc->arena.head = NULL;
+	doc->references = NULL;
+	doc->run = NULL;
+	doc->block = NULL;
 
 	memset(doc->active_char, 0x0, 256);
 
@@ -2719,6 +3562,29 @@ hoedown_document_new(
 	if (extensions & HOEDOWN_EXT_QUOTE)
 		doc->active_char['"'] = MD_CHAR_QUOTE;
 
+	hoedown_scanner_init(&doc->active_scan, doc->active_char);
+
+	memset(doc->block_char, 0x0, 256);
+
+	doc->block_char['#'] |= MD_BLOCK_ATXHEADER;
+	doc->block_char['='] |= MD_BLOCK_SETEXT;
+	doc->block_char['-'] |= MD_BLOCK_SETEXT | MD_BLOCK_HRULE | MD_BLOCK_ULI;
+	doc->block_char['*'] |= MD_BLOCK_HRULE | MD_BLOCK_ULI;
+	doc->block_char['_'] |= MD_BLOCK_HRULE;
+	doc->block_char['+'] |= MD_BLOCK_ULI;
+	doc->block_char['>'] |= MD_BLOCK_QUOTE;
+
+	for (i = '0'; i <= '9'; i++)
+		doc->block_char[i] |= MD_BLOCK_OLI;
+
+	if (doc->md.blockhtml)
+		doc->block_char['<'] |= MD_BLOCK_HTML;
+
+	if (extensions & HOEDOWN_EXT_FENCED_CODE) {
+		doc->block_char['`'] |= MD_BLOCK_FENCE;
+		doc->block_char['~'] |= MD_BLOCK_FENCE;
+	}
+
 	/* Extension data */
 	doc->ext_flags = extensions;
 	doc->max_nesting = max_nesting;
@@ -2733,7 +3599,9 @@ hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t
 	static const uint8_t UTF8_BOM[] = {0xEF, 0xBB, 0xBF};
 
 	hoedown_buffer *text;
-	size_t beg, end;
+	const uint8_t *data;
+	size_t beg, end, line_end, clean, size;
+	int has_tab;
 
 	int footnotes_enabled;
 
@@ -2741,11 +3609,8 @@ hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t
 	if (!text)
 		return;
 
-	/* Preallocate enough space for our buffer to avoid expanding while copying */
-	hoedown_buffer_grow(text, doc_size);
-
 	/* reset the references table */
-	memset(&doc->refs, 0x0, REF_TABLE_SIZE * sizeof(void *));
+	memset(&doc->refs, 0x0, sizeof(doc->refs));
 	
 	footnotes_enabled = doc->ext_flags & HOEDOWN_EXT_FOOTNOTES;
 	
@@ -2763,20 +3628,45 @@ hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t
 	if (doc_size >= 3 && memcmp(document, UTF8_BOM, 3) == 0)
 		beg += 3;
 
+	/* lines from clean onwards need no changes, and are only copied
+	 * once something after them has to be left out or rewritten */
+	clean = beg;
+
 	while (beg < doc_size) /* iterating over lines */
-		if (footnotes_enabled && is_footnote(document, beg, doc_size, &end, &doc->footnotes_found))
-			beg = end;
-		else if (is_ref(document, beg, doc_size, &end, doc->refs))
-			beg = end;
-		else { /* skipping to the next line */
+		if ((footnotes_enabled && is_footnote(document, beg, doc_size, &end, doc)) ||
+			is_ref(document, beg, doc_size, &end, &doc->arena, &doc->refs)) {
+			if (beg > clean)
+				copy_text(text, document + clean, beg - clean, doc_size);
+
+			beg = clean = end;
+		} else { /* skipping to the next line */
+			has_tab = 0;
 			end = beg;
-			while (end < doc_size && document[end] != '\n' && document[end] != '\r')
+			while (end < doc_size && document[end] != '\n' && document[end] != '\r') {
+				if (document[end] == '\t')
+					has_tab = 1;
+				end++;
+			}
+
+			line_end = end;
+			while (end < doc_size && document[end] == '\n')
 				end++;
 
+			/* without tabs or CRs the line is copied as it is, but blockquotes
+			 * are parsed in place, so they must not be left in the document */
+			if (!has_tab && (end >= doc_size || document[end] != '\r') &&
+				!prefix_quote((uint8_t *)document + beg, line_end - beg)) {
+				beg = end;
+				continue;
+			}
+
+			copy_text(text, document + clean, beg - clean, doc_size);
+
 			/* adding the line body if present */
-			if (end > beg)
-				expand_tabs(text, document + beg, end - beg);
+			if (line_end > beg)
+				expand_tabs(text, document + beg, line_end - beg);
 
+			end = line_end;
 			while (end < doc_size && (document[end] == '\n' || document[end] == '\r')) {
 				/* add one \n per newline */
 				if (document[end] == '\n' || (end + 1 < doc_size && document[end + 1] != '\n'))
@@ -2784,23 +3674,34 @@ hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t
 				end++;
 			}
 
-			beg = end;
+			beg = clean = end;
 		}
 
+	/* when nothing had to change, the document is parsed in place */
+	if (text->size == 0 && (clean == doc_size || document[doc_size - 1] == '\n')) {
+		data = document + clean;
+		size = doc_size - clean;
+	} else {
+		if (doc_size > clean)
+			copy_text(text, document + clean, doc_size - clean, doc_size);
+
+		/* adding a final newline if not already present */
+		if (text->size && text->data[text->size - 1] != '\n' && text->data[text->size - 1] != '\r')
+			hoedown_buffer_putc(text, '\n');
+
+		data = text->data;
+		size = text->size;
+	}
+
 	/* pre-grow the output buffer to minimize allocations */
-	hoedown_buffer_grow(ob, text->size + (text->size >> 1));
+	hoedown_buffer_grow(ob, size + (size >> 1));
 
 	/* second pass: actual rendering */
 	if (doc->md.doc_header)
 		doc->md.doc_header(ob, doc->md.opaque);
 
-	if (text->size) {
-		/* adding a final newline if not already present */
-		if (text->data[text->size - 1] != '\n' &&  text->data[text->size - 1] != '\r')
-			hoedown_buffer_putc(text, '\n');
-
-		parse_block(ob, doc, text->data, text->size);
-	}
+	if (size)
+		parse_block(ob, doc, (uint8_t *)data, size);
 	
 	/* footnotes */
 	if (footnotes_enabled)
@@ -2811,14 +3712,18 @@ hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t
 
 	/* clean-up */
 	hoedown_buffer_free(text);
-	free_link_refs(doc->refs);
-	if (footnotes_enabled) {
-		free_footnote_list(&doc->footnotes_found, 1);
-		free_footnote_list(&doc->footnotes_used, 0);
-	}
+	arena_reset(&doc->arena);
 
 	assert(doc->work_bufs[BUFFER_SPAN].size == 0);
 	assert(doc->work_bufs[BUFFER_BLOCK].size == 0);
+	assert(doc->work_bufs[BUFFER_LINES].size == 0);
+	assert(doc->work_bufs[BUFFER_INLINE].size == 0);
+}
+
+void
+hoedown_document_set_references(hoedown_document *doc, const hoedown_references *refs)
+{
+	doc->references = refs;
 }
 
 void
@@ -2832,8 +3737,104 @@ hoedown_document_free(hoedown_document *doc)
 	for (i = 0; i < (size_t)doc->work_bufs[BUFFER_BLOCK].asize; ++i)
 		hoedown_buffer_free(doc->work_bufs[BUFFER_BLOCK].item[i]);
 
+	for (i = 0; i < (size_t)doc->work_bufs[BUFFER_LINES].asize; ++i)
+		hoedown_buffer_free(doc->work_bufs[BUFFER_LINES].item[i]);
+
+	for (i = 0; i < (size_t)doc->work_bufs[BUFFER_INLINE].asize; ++i)
+		hoedown_buffer_free(doc->work_bufs[BUFFER_INLINE].item[i]);
+
 	hoedown_stack_free(&doc->work_bufs[BUFFER_SPAN]);
 	hoedown_stack_free(&doc->work_bufs[BUFFER_BLOCK]);
+	hoedown_stack_free(&doc->work_bufs[BUFFER_LINES]);
+	hoedown_stack_free(&doc->work_bufs[BUFFER_INLINE]);
+
+	arena_free(&doc->arena);
+
+	hoedown_free(doc);
+}
+
+hoedown_references *
+hoedown_references_new(void)
+{
+	hoedown_references *refs = hoedown_malloc(sizeof(hoedown_references));
+	if (!refs)
+		return NULL;
+
+	memset(refs, 0x0, sizeof(hoedown_references));
+	return refs;
+}
+
+int
+hoedown_references_add(
+	hoedown_references *refs,
+	const uint8_t *name, size_t name_size,
+	const uint8_t *link, size_t link_size,
+	const uint8_t *title, size_t title_size)
+{
+	struct link_ref *ref;
+	uint8_t *copy;
+
+	copy = arena_alloc(&refs->arena, name_size ? name_size : 1);
+	if (!copy)
+		return 0;
+
+	memcpy(copy, name, name_size);
+
+	ref = add_link_ref(&refs->arena, &refs->table, copy, name_size);
+	if (!ref)
+		return 0;
+
+	ref->link = arena_buffer(&refs->arena, link, link_size);
+	if (!ref->link)
+		return 0;
+
+	if (title && title_size) {
+		ref->title = arena_buffer(&refs->arena, title, title_size);
+		if (!ref->title)
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+hoedown_references_parse(hoedown_references *refs, const uint8_t *data, size_t size)
+{
+	hoedown_buffer *copy;
+	size_t beg = 0, end;
+
+	/* the names of the references point into the text they were defined in */
+	copy = arena_buffer(&refs->arena, data, size);
+	if (!copy)
+		return 0;
+
+	data = copy->data;
+
+	while (beg < size) {
+		if (is_ref(data, beg, size, &end, &refs->arena, &refs->table)) {
+			beg = end;
+			continue;
+		}
+
+		end = beg;
+		while (end < size && data[end] != '\n' && data[end] != '\r')
+			end++;
+
+		while (end < size && (data[end] == '\n' || data[end] == '\r'))
+			end++;
+
+		beg = end;
+	}
+
+	return 1;
+}
+
+void
+hoedown_references_free(hoedown_references *refs)
+{
+	if (!refs)
+		return;
 
-	free(doc);
+	arena_free(&refs->arena);
+	hoedown_free(refs);
 }
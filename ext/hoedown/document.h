@@ -135,6 +135,10 @@ struct hoedown_document;
 
 typedef struct hoedown_document hoedown_document;
 
+struct hoedown_references;
+
+typedef struct hoedown_references hoedown_references;
+
 /**********************
  * EXPORTED FUNCTIONS *
  **********************/
@@ -148,9 +152,32 @@ hoedown_document_new(
 extern void
 hoedown_document_render(hoedown_document *doc, hoedown_buffer *ob, const uint8_t *document, size_t doc_size);
 
+/* hoedown_document_set_references: references looked up after those the document defines; they are only read while rendering (NULL removes them) */
+extern void
+hoedown_document_set_references(hoedown_document *doc, const hoedown_references *refs);
+
 extern void
 hoedown_document_free(hoedown_document *doc);
 
+/* hoedown_references_new: allocation of an empty set of references */
+extern hoedown_references *
+hoedown_references_new(void);
+
+/* hoedown_references_add: adds a reference, replacing an earlier one of the same name */
+extern int
+hoedown_references_add(
+	hoedown_references *refs,
+	const uint8_t *name, size_t name_size,
+	const uint8_t *link, size_t link_size,
+	const uint8_t *title, size_t title_size);
+
+/* hoedown_references_parse: adds the reference definitions found in Markdown text */
+extern int
+hoedown_references_parse(hoedown_references *refs, const uint8_t *data, size_t size);
+
+extern void
+hoedown_references_free(hoedown_references *refs);
+
 #ifdef __cplusplus
 }
 #endif
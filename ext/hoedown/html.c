@@ -644,7 +644,7 @@ hoedown_html_toc_renderer_new(int nesting_level)
 	hoedown_renderer *renderer;
 
 	/* Prepare the state pointer */
-	state = malloc(sizeof(hoedown_html_renderer_state));
+	state = hoedown_malloc(sizeof(hoedown_html_renderer_state));
 	if (!state)
 		return NULL;
 
@@ -656,9 +656,9 @@ hoedown_html_toc_renderer_new(int nesting_level)
 	}
 
 	/* Prepare the renderer */
-	renderer = malloc(sizeof(hoedown_renderer));
+	renderer = hoedown_malloc(sizeof(hoedown_renderer));
 	if (!renderer) {
-		free(state);
+		hoedown_free(state);
 		return NULL;
 	}
 
@@ -715,7 +715,7 @@ hoedown_html_renderer_new(unsigned int render_flags, int nesting_level)
 	hoedown_renderer *renderer;
 
 	/* Prepare the state pointer */
-	state = malloc(sizeof(hoedown_html_renderer_state));
+	state = hoedown_malloc(sizeof(hoedown_html_renderer_state));
 	if (!state)
 		return NULL;
 
@@ -729,9 +729,9 @@ hoedown_html_renderer_new(unsigned int render_flags, int nesting_level)
 	}
 
 	/* Prepare the renderer */
-	renderer = malloc(sizeof(hoedown_renderer));
+	renderer = hoedown_malloc(sizeof(hoedown_renderer));
 	if (!renderer) {
-		free(state);
+		hoedown_free(state);
 		return NULL;
 	}
 
@@ -755,6 +755,6 @@ hoedown_html_renderer_new(unsigned int render_flags, int nesting_level)
 void
 hoedown_html_renderer_free(hoedown_renderer *renderer)
 {
-	free(renderer->opaque);
-	free(renderer);
+	hoedown_free(renderer->opaque);
+	hoedown_free(renderer);
 }
@@ -339,6 +339,10 @@ smartypants_cb__ltag(hoedown_buffer *ob, struct smartypants_data *smrt, uint8_t
 			i++;
 	}
 
+	/* an unclosed tag runs to the end of the text */
+	if (i == size)
+		i--;
+
 	hoedown_buffer_put(ob, text, i + 1);
 	return i;
 }
@@ -0,0 +1,145 @@
+#include "scan.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HOEDOWN_SCAN_X86
+#include <immintrin.h>
+#endif
+
+enum scan_kernel {
+	SCAN_SCALAR = 0,
+	SCAN_SSSE3,
+	SCAN_AVX2
+};
+
+/*
+ * The vector kernels classify 16 or 32 bytes at once with two table
+ * lookups on the nibbles of each byte: lo_mask[b & 0xf] has bit (b >> 4)
+ * set for every member b of the set, and hi_mask[b >> 4] is that single
+ * bit, so their AND is non-zero exactly for the members. Only the high
+ * nibbles 0-7 get a bit, which is why a set containing a byte above 0x7f
+ * falls back to the scalar loop.
+ */
+
+#ifdef HOEDOWN_SCAN_X86
+
+/* scan_ssse3 • inlined into both kernels, so that the AVX2 one finishes
+ * with VEX encoded instructions and no SSE/AVX transition penalty */
+__attribute__((target("ssse3"), always_inline))
+static inline size_t
+scan_ssse3(const hoedown_scanner *scanner, const uint8_t *data, size_t pos, size_t size)
+{
+	const __m128i lo_mask = _mm_loadu_si128((const __m128i *)scanner->lo_mask);
+	const __m128i hi_mask = _mm_loadu_si128((const __m128i *)scanner->hi_mask);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+
+	while (size - pos >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + pos));
+		__m128i lo = _mm_shuffle_epi8(lo_mask, _mm_and_si128(v, nibble));
+		__m128i hi = _mm_shuffle_epi8(hi_mask, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		unsigned int hits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) & 0xffff;
+
+		if (hits)
+			return pos + __builtin_ctz(hits);
+
+		pos += 16;
+	}
+
+	return pos;
+}
+
+__attribute__((target("ssse3")))
+static size_t
+find_ssse3(const hoedown_scanner *scanner, const uint8_t *data, size_t pos, size_t size)
+{
+	return scan_ssse3(scanner, data, pos, size);
+}
+
+__attribute__((target("avx2")))
+static size_t
+find_avx2(const hoedown_scanner *scanner, const uint8_t *data, size_t pos, size_t size)
+{
+	const __m256i lo_mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)scanner->lo_mask));
+	const __m256i hi_mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)scanner->hi_mask));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (size - pos >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(data + pos));
+		__m256i lo = _mm256_shuffle_epi8(lo_mask, _mm256_and_si256(v, nibble));
+		__m256i hi = _mm256_shuffle_epi8(hi_mask, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+		unsigned int hits = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero));
+
+		if (hits)
+			return pos + __builtin_ctz(hits);
+
+		pos += 32;
+	}
+
+	return scan_ssse3(scanner, data, pos, size);
+}
+
+#endif
+
+void
+hoedown_scanner_init(hoedown_scanner *scanner, const uint8_t *table)
+{
+	int c, ascii = 1;
+
+	scanner->table = table;
+	memset(scanner->lo_mask, 0x0, sizeof(scanner->lo_mask));
+	memset(scanner->hi_mask, 0x0, sizeof(scanner->hi_mask));
+
+	for (c = 0; c < 256; c++) {
+		if (!table[c])
+			continue;
+
+		if (c > 0x7f)
+			ascii = 0;
+		else
+			scanner->lo_mask[c & 0xf] |= 1 << (c >> 4);
+	}
+
+	for (c = 0; c < 8; c++)
+		scanner->hi_mask[c] = 1 << c;
+
+	scanner->kernel = SCAN_SCALAR;
+
+#ifdef HOEDOWN_SCAN_X86
+	if (ascii) {
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2"))
+			scanner->kernel = SCAN_AVX2;
+		else if (__builtin_cpu_supports("ssse3"))
+			scanner->kernel = SCAN_SSSE3;
+	}
+#else
+	(void)ascii;
+#endif
+}
+
+size_t
+hoedown_scanner_find(const hoedown_scanner *scanner, const uint8_t *data, size_t pos, size_t size)
+{
+	const uint8_t *table = scanner->table;
+
+#ifdef HOEDOWN_SCAN_X86
+	switch (scanner->kernel) {
+	case SCAN_AVX2:
+		pos = find_avx2(scanner, data, pos, size);
+		break;
+	case SCAN_SSSE3:
+		pos = find_ssse3(scanner, data, pos, size);
+		break;
+	}
+#endif
+
+	/* the scalar loop finishes whatever the kernels left */
+	while (pos < size && table[data[pos]] == 0)
+		pos++;
+
+	return pos;
+}
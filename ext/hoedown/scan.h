@@ -0,0 +1,35 @@
+/* scan.h - vectorized search for a set of bytes */
+
+#ifndef HOEDOWN_SCAN_H
+#define HOEDOWN_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hoedown_scanner {
+	const uint8_t *table;
+	uint8_t lo_mask[16];
+	uint8_t hi_mask[16];
+	int kernel;
+};
+
+typedef struct hoedown_scanner hoedown_scanner;
+
+/* hoedown_scanner_init: prepares a scanner for the bytes whose entry in table
+ * (256 entries, kept by reference) is non-zero, picking the widest kernel the
+ * CPU supports; the table must not change while the scanner is in use */
+void hoedown_scanner_init(hoedown_scanner *scanner, const uint8_t *table);
+
+/* hoedown_scanner_find: offset of the first byte of the set in data[pos, size),
+ * or size if there is none */
+size_t hoedown_scanner_find(const hoedown_scanner *scanner, const uint8_t *data, size_t pos, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /** HOEDOWN_SCAN_H **/
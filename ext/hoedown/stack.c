@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include "buffer.h"
+
 int
 hoedown_stack_new(hoedown_stack *st, size_t initial_size)
 {
@@ -21,7 +23,7 @@ hoedown_stack_free(hoedown_stack *st)
 	if (!st)
 		return;
 
-	free(st->item);
+	hoedown_free(st->item);
 
 	st->item = NULL;
 	st->size = 0;
@@ -36,7 +38,7 @@ hoedown_stack_grow(hoedown_stack *st, size_t new_size)
 	if (st->asize >= new_size)
 		return 0;
 
-	new_st = realloc(st->item, new_size * sizeof(void *));
+	new_st = hoedown_realloc(st->item, new_size * sizeof(void *));
 	if (new_st == NULL)
 		return -1;
 
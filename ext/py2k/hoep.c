@@ -1,4 +1,5 @@
 #include <Python.h>
+#include <pythread.h>
 #include <structmember.h>
 
 #include "../hoedown/html.h"
@@ -17,9 +18,44 @@ typedef struct {
     hoedown_renderer *renderer;
     hoedown_document *document;
     hoedown_buffer *buffer;
+    int native;
+    PyThread_type_lock lock;
+    long owner;
 } Hoep;
 
 
+/* The document and buffer of an instance are only safe to use from one
+ * thread at a time, so the instance lock is taken around every render. */
+static int Hoep_acquire(Hoep *self) {
+    int acquired;
+    
+    
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        if (self->owner == PyThread_get_thread_ident()) {
+            PyErr_SetString(PyExc_RuntimeError, "render() cannot be called from within a callback");
+            
+            return -1;
+        }
+        
+        Py_BEGIN_ALLOW_THREADS
+        acquired = PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+        
+        if (!acquired) return -1;
+    }
+    
+    self->owner = PyThread_get_thread_ident();
+    
+    return 0;
+}
+
+static void Hoep_release(Hoep *self) {
+    self->owner = 0;
+    
+    PyThread_release_lock(self->lock);
+}
+
+
 static PyObject *render(PyObject *self, PyObject *args, PyObject *kwargs) {
     static char *kwparams[] = {"markdown", "extensions", "render_flags", NULL};
     
@@ -46,7 +82,9 @@ static PyObject *render(PyObject *self, PyObject *args, PyObject *kwargs) {
     md = (const uint8_t *) PyString_AsString(markdown);
     md_size = PyString_Size(markdown);
     
+    Py_BEGIN_ALLOW_THREADS
     hoedown_document_render(document, buffer, md, md_size);
+    Py_END_ALLOW_THREADS
     
     Py_DECREF(markdown);
     
@@ -96,9 +134,24 @@ static int Hoep_init(Hoep *self, PyObject *args, PyObject *kwargs) {
     hd_callbacks = (void **) self->renderer;
     hp_callbacks = (void **) &hoep_callbacks;
     
+    /* Without any overridden callbacks nothing calls back into Python
+     * while rendering, so the GIL can be released. */
+    self->native = 1;
+    
     for (i = 0; method_names[i] != NULL; i++) {
         if (PyObject_HasAttrString((PyObject *) self, (const char *) method_names[i])) {
             hd_callbacks[i + 1] = hp_callbacks[i + 1];
+            
+            self->native = 0;
+        }
+    }
+    
+    if (self->lock == NULL) {
+        self->lock = PyThread_allocate_lock();
+        if (self->lock == NULL) {
+            PyErr_NoMemory();
+            
+            return -1;
         }
     }
     
@@ -131,11 +184,19 @@ static PyObject *Hoep_render(Hoep *self, PyObject *args) {
         markdown = PyUnicode_AsUTF8String(unicode);
     }
     
+    if (Hoep_acquire(self) < 0) goto exc_lock;
+    
     /* markdown */
     md = (const uint8_t *) PyString_AsString(markdown);
     md_size = PyString_Size(markdown);
     
-    hoedown_document_render(self->document, self->buffer, md, md_size);
+    if (self->native) {
+        Py_BEGIN_ALLOW_THREADS
+        hoedown_document_render(self->document, self->buffer, md, md_size);
+        Py_END_ALLOW_THREADS
+    } else {
+        hoedown_document_render(self->document, self->buffer, md, md_size);
+    }
     
     Py_DECREF(markdown);
     
@@ -167,6 +228,8 @@ static PyObject *Hoep_render(Hoep *self, PyObject *args) {
     
     hoedown_buffer_reset(self->buffer);
     
+    Hoep_release(self);
+    
     return html;
     
     exc_post_u:;
@@ -181,6 +244,12 @@ static PyObject *Hoep_render(Hoep *self, PyObject *args) {
         
         hoedown_buffer_reset(self->buffer);
         
+        Hoep_release(self);
+        
+        return NULL;
+    exc_lock:
+        Py_DECREF(markdown);
+        
         return NULL;
     exc_pre:
         Py_DECREF(pre);
@@ -192,6 +261,7 @@ static void Hoep_dealloc(Hoep *self) {
     hoedown_buffer_free(self->buffer);
     if (self->document != NULL) hoedown_document_free(self->document);
     if (self->renderer != NULL) hoedown_html_renderer_free(self->renderer);
+    if (self->lock != NULL) PyThread_free_lock(self->lock);
     
     self->ob_type->tp_free((PyObject *) self);
 }
@@ -0,0 +1,182 @@
+#include <Python.h>
+#include <pythread.h>
+
+#include "../hoedown/html.h"
+
+#include "batch.h"
+
+
+#ifndef PYTHREAD_INVALID_THREAD_ID
+#define PYTHREAD_INVALID_THREAD_ID ((unsigned long) -1)
+#endif
+
+
+typedef struct {
+    hoep_batch_item *items;
+    size_t count;
+    size_t next;
+    unsigned int extensions;
+    unsigned int render_flags;
+    int smartypants;
+    const hoedown_references *references;
+    int failed;
+    int running;
+    PyThread_type_lock mutex;
+    PyThread_type_lock done;
+} hoep_batch;
+
+
+static void batch_lock(hoep_batch *batch) {
+    if (batch->mutex != NULL) PyThread_acquire_lock(batch->mutex, WAIT_LOCK);
+}
+
+static void batch_unlock(hoep_batch *batch) {
+    if (batch->mutex != NULL) PyThread_release_lock(batch->mutex);
+}
+
+/* Every worker owns its renderer, document and buffers, so nothing but the
+ * job counter is shared between threads. */
+static void batch_work(hoep_batch *batch) {
+    hoedown_renderer *renderer;
+    hoedown_document *document;
+    hoedown_buffer *buffer, *html;
+    hoep_batch_item *item;
+    size_t i;
+    int failed = 0;
+    
+    
+    renderer = hoedown_html_renderer_new(batch->render_flags, 0);
+    document = renderer ? hoedown_document_new(renderer, batch->extensions, 16) : NULL;
+    buffer = hoedown_buffer_new(16);
+    
+    if (document == NULL || buffer == NULL) {
+        failed = 1;
+        
+        goto cleanup;
+    }
+    
+    hoedown_document_set_references(document, batch->references);
+    
+    for (;;) {
+        batch_lock(batch);
+        i = batch->next++;
+        batch_unlock(batch);
+        
+        if (i >= batch->count) break;
+        
+        item = &batch->items[i];
+        
+        html = hoedown_buffer_new(16);
+        if (html == NULL) {
+            failed = 1;
+            
+            continue;
+        }
+        
+        if (batch->smartypants) {
+            hoedown_document_render(document, buffer, item->markdown, item->size);
+            hoedown_html_smartypants(html, buffer->data, buffer->size);
+            
+            buffer->size = 0;
+        } else {
+            hoedown_document_render(document, html, item->markdown, item->size);
+        }
+        
+        item->html = html;
+    }
+    
+    cleanup:
+        hoedown_buffer_free(buffer);
+        if (document != NULL) hoedown_document_free(document);
+        if (renderer != NULL) hoedown_html_renderer_free(renderer);
+        
+        if (failed) {
+            batch_lock(batch);
+            batch->failed = 1;
+            batch_unlock(batch);
+        }
+}
+
+static void batch_worker(void *arg) {
+    hoep_batch *batch = (hoep_batch *) arg;
+    int last;
+    
+    
+    batch_work(batch);
+    
+    batch_lock(batch);
+    last = --batch->running == 0;
+    batch_unlock(batch);
+    
+    /* The batch may be freed as soon as this is released. */
+    if (last) PyThread_release_lock(batch->done);
+}
+
+
+int hoep_batch_render(hoep_batch_item *items, size_t count, unsigned int extensions, unsigned int render_flags, int smartypants,
+    const hoedown_references *references, int threads) {
+    hoep_batch batch;
+    int i, last;
+    
+    
+    if (count == 0) return 1;
+    
+    if (threads < 1) threads = 1;
+    if ((size_t) threads > count) threads = (int) count;
+    
+    batch.items = items;
+    batch.count = count;
+    batch.next = 0;
+    batch.extensions = extensions;
+    batch.render_flags = render_flags;
+    batch.smartypants = smartypants;
+    batch.references = references;
+    batch.failed = 0;
+    batch.running = 0;
+    batch.mutex = NULL;
+    batch.done = NULL;
+    
+    if (threads > 1) {
+        batch.mutex = PyThread_allocate_lock();
+        batch.done = PyThread_allocate_lock();
+        
+        if (batch.mutex == NULL || batch.done == NULL) threads = 1;
+    }
+    
+    if (threads > 1) {
+        PyThread_acquire_lock(batch.done, WAIT_LOCK);
+        
+        /* The calling thread is a worker as well; whichever worker finishes
+         * last signals `done`, unless that is the calling thread itself. */
+        batch.running = 1;
+        
+        for (i = 1; i < threads; i++) {
+            batch_lock(&batch);
+            batch.running++;
+            batch_unlock(&batch);
+            
+            if (PyThread_start_new_thread(batch_worker, &batch) == PYTHREAD_INVALID_THREAD_ID) {
+                batch_lock(&batch);
+                batch.running--;
+                batch_unlock(&batch);
+                
+                break;
+            }
+        }
+        
+        batch_work(&batch);
+        
+        batch_lock(&batch);
+        last = --batch.running == 0;
+        batch_unlock(&batch);
+        
+        if (!last) PyThread_acquire_lock(batch.done, WAIT_LOCK);
+    } else {
+        batch_work(&batch);
+    }
+    
+    if (batch.mutex != NULL) PyThread_free_lock(batch.mutex);
+    if (batch.done != NULL) PyThread_free_lock(batch.done);
+    
+    return !batch.failed;
+}
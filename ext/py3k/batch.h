@@ -0,0 +1,15 @@
+#include "../hoedown/document.h"
+
+
+typedef struct {
+    const uint8_t *markdown;
+    size_t size;
+    hoedown_buffer *html;
+} hoep_batch_item;
+
+
+/* Renders every item into its own html buffer using up to `threads` native
+ * threads, all of them sharing the optional `references`. Must be called
+ * without the GIL held; returns 0 if any item could not be rendered. */
+int hoep_batch_render(hoep_batch_item *items, size_t count, unsigned int extensions, unsigned int render_flags, int smartypants,
+    const hoedown_references *references, int threads);
@@ -0,0 +1,154 @@
+#include <Python.h>
+
+#include "../hoedown/html.h"
+
+#include "cache.h"
+
+
+#define HOEP_CACHE_SIZE 4
+#define HOEP_CACHE_KEY "hoep.engines"
+
+
+typedef struct {
+    hoep_engine engines[HOEP_CACHE_SIZE];
+    int count;
+    unsigned long clock;
+    unsigned long generation;
+} hoep_cache;
+
+
+/* Bumped by hoep_cache_clear(); caches from an older generation are
+ * emptied before they are used again. Only touched with the GIL held. */
+static unsigned long cache_generation = 0;
+
+
+static void engine_setup(hoep_engine *engine, unsigned int extensions, unsigned int render_flags) {
+    engine->extensions = extensions;
+    engine->render_flags = render_flags;
+    engine->renderer = hoedown_html_renderer_new(render_flags, 0);
+    engine->document = hoedown_document_new(engine->renderer, extensions, 16);
+    engine->buffer = hoedown_buffer_new(16);
+    engine->scratch = hoedown_buffer_new(16);
+}
+
+static void engine_teardown(hoep_engine *engine) {
+    hoedown_buffer_free(engine->scratch);
+    hoedown_buffer_free(engine->buffer);
+    hoedown_document_free(engine->document);
+    hoedown_html_renderer_free(engine->renderer);
+}
+
+static void cache_empty(hoep_cache *cache) {
+    int i;
+    
+    
+    for (i = 0; i < cache->count; i++) {
+        engine_teardown(&cache->engines[i]);
+    }
+    
+    cache->count = 0;
+    cache->generation = cache_generation;
+}
+
+static void cache_destroy(PyObject *capsule) {
+    hoep_cache *cache = PyCapsule_GetPointer(capsule, HOEP_CACHE_KEY);
+    
+    
+    cache_empty(cache);
+    
+    PyMem_Free(cache);
+}
+
+/* The cache lives in the thread state dict, so it is freed along with the
+ * thread that owns it. */
+static hoep_cache *cache_lookup(int create) {
+    hoep_cache *cache;
+    PyObject *dict, *capsule;
+    
+    
+    dict = PyThreadState_GetDict();
+    if (dict == NULL) {
+        if (create) PyErr_SetString(PyExc_RuntimeError, "thread state is unavailable");
+        
+        return NULL;
+    }
+    
+    capsule = PyDict_GetItemString(dict, HOEP_CACHE_KEY);
+    if (capsule != NULL) return PyCapsule_GetPointer(capsule, HOEP_CACHE_KEY);
+    if (!create) return NULL;
+    
+    cache = PyMem_Calloc(1, sizeof(hoep_cache));
+    if (cache == NULL) {
+        PyErr_NoMemory();
+        
+        return NULL;
+    }
+    
+    cache->generation = cache_generation;
+    
+    capsule = PyCapsule_New(cache, HOEP_CACHE_KEY, cache_destroy);
+    if (capsule == NULL) {
+        PyMem_Free(cache);
+        
+        return NULL;
+    }
+    
+    if (PyDict_SetItemString(dict, HOEP_CACHE_KEY, capsule) < 0) cache = NULL;
+    
+    Py_DECREF(capsule);
+    
+    return cache;
+}
+
+
+hoep_engine *hoep_engine_acquire(unsigned int extensions, unsigned int render_flags) {
+    hoep_cache *cache;
+    hoep_engine *engine;
+    int i;
+    
+    
+    cache = cache_lookup(1);
+    if (cache == NULL) return NULL;
+    
+    if (cache->generation != cache_generation) cache_empty(cache);
+    
+    for (i = 0; i < cache->count; i++) {
+        engine = &cache->engines[i];
+        
+        if (engine->extensions == extensions && engine->render_flags == render_flags) goto found;
+    }
+    
+    if (cache->count < HOEP_CACHE_SIZE) {
+        engine = &cache->engines[cache->count++];
+    } else {
+        engine = &cache->engines[0];
+        
+        for (i = 1; i < cache->count; i++) {
+            if (cache->engines[i].used < engine->used) engine = &cache->engines[i];
+        }
+        
+        engine_teardown(engine);
+    }
+    
+    engine_setup(engine, extensions, render_flags);
+    
+    found:
+        engine->used = ++cache->clock;
+        
+        return engine;
+}
+
+void hoep_engine_release(hoep_engine *engine) {
+    hoedown_buffer_reset(engine->buffer);
+    hoedown_buffer_reset(engine->scratch);
+}
+
+void hoep_cache_clear(void) {
+    hoep_cache *cache;
+    
+    
+    cache_generation++;
+    
+    cache = cache_lookup(0);
+    if (cache != NULL) cache_empty(cache);
+}
@@ -0,0 +1,27 @@
+#include "../hoedown/document.h"
+
+
+typedef struct {
+    unsigned int extensions;
+    unsigned int render_flags;
+    hoedown_renderer *renderer;
+    hoedown_document *document;
+    hoedown_buffer *buffer;
+    hoedown_buffer *scratch;
+    unsigned long used;
+} hoep_engine;
+
+
+/* Hands out the calling thread's engine for (extensions, render_flags),
+ * setting one up if it is not cached yet. Each thread keeps at most
+ * HOEP_CACHE_SIZE engines and drops the least recently used one when
+ * full. Must be called with the GIL held; returns NULL with an exception
+ * set on failure. */
+hoep_engine *hoep_engine_acquire(unsigned int extensions, unsigned int render_flags);
+
+/* Gives an engine back once its output has been consumed. */
+void hoep_engine_release(hoep_engine *engine);
+
+/* Drops the cached engines of every thread. The calling thread's are freed
+ * right away, the others' the next time those threads render. */
+void hoep_cache_clear(void);
@@ -1,8 +1,13 @@
+#define PY_SSIZE_T_CLEAN
+
 #include <Python.h>
+#include <pythread.h>
 #include <structmember.h>
 
 #include "../hoedown/html.h"
 
+#include "batch.h"
+#include "cache.h"
 #include "wrapper.h"
 
 
@@ -10,6 +15,16 @@ typedef enum {
     HOEP_HTML_SMARTYPANTS = (1 << 10)
 } hoep_html_render_mode;
 
+#define HOEP_BUFFER_LIMIT (4 << 20)
+#define HOEP_SHRINK_RATIO 10
+#define HOEP_REFERENCES "hoep.references"
+
+
+typedef enum {
+    HOEP_OUTPUT_STR,
+    HOEP_OUTPUT_BYTES
+} hoep_output;
+
 typedef struct {
     PyObject_HEAD
     unsigned int extensions;
@@ -17,166 +32,973 @@ typedef struct {
     hoedown_renderer *renderer;
     hoedown_document *document;
     hoedown_buffer *buffer;
+    hoedown_buffer *scratch;
+    Py_ssize_t buffer_limit;
+    Py_ssize_t shrink_ratio;
+    size_t average;
+    PyObject *methods[HOEP_METHOD_COUNT];
+    PyObject *preprocess;
+    PyObject *postprocess;
+    PyObject *references;
+    int native;
+    PyThread_type_lock lock;
+    unsigned long owner;
 } Hoep;
 
 
+/* The document and buffer of an instance are only safe to use from one
+ * thread at a time, so the instance lock is taken around every render. */
+static int Hoep_acquire(Hoep *self) {
+    int acquired;
+    
+    
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        if (self->owner == PyThread_get_thread_ident()) {
+            PyErr_SetString(PyExc_RuntimeError, "render() cannot be called from within a callback");
+            
+            return -1;
+        }
+        
+        Py_BEGIN_ALLOW_THREADS
+        acquired = PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+        
+        if (!acquired) return -1;
+    }
+    
+    self->owner = PyThread_get_thread_ident();
+    
+    return 0;
+}
+
+static void Hoep_release(Hoep *self) {
+    self->owner = 0;
+    
+    PyThread_release_lock(self->lock);
+}
+
+
+/* Exposes the UTF-8 bytes of a str, or the contents of any bytes-like
+ * object, without copying them. */
+static int markdown_buffer(PyObject *markdown, Py_buffer *view) {
+    const char *data;
+    Py_ssize_t size;
+    PyObject *message;
+    
+    
+    if (PyUnicode_Check(markdown)) {
+        data = PyUnicode_AsUTF8AndSize(markdown, &size);
+        if (data == NULL) return -1;
+        
+        return PyBuffer_FillInfo(view, markdown, (void *) data, size, 1, PyBUF_SIMPLE);
+    }
+    
+    if (!PyObject_CheckBuffer(markdown)) {
+        message = PyUnicode_FromFormat("must be str or a bytes-like object, %s received", Py_TYPE(markdown)->tp_name);
+        
+        PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
+        
+        Py_DECREF(message);
+        
+        return -1;
+    }
+    
+    return PyObject_GetBuffer(markdown, view, PyBUF_SIMPLE);
+}
+
+/* Returns Markdown as a str for the Python callbacks, decoding bytes-like
+ * input as UTF-8. */
+static PyObject *markdown_str(PyObject *markdown) {
+    Py_buffer view;
+    PyObject *str;
+    
+    
+    if (PyUnicode_Check(markdown)) {
+        Py_INCREF(markdown);
+        
+        return markdown;
+    }
+    
+    if (markdown_buffer(markdown, &view) < 0) return NULL;
+    
+    str = PyUnicode_DecodeUTF8(view.buf, view.len, "strict");
+    
+    PyBuffer_Release(&view);
+    
+    return str;
+}
+
+
+/* Maps the output keyword onto an hoep_output value. */
+static int output_mode(const char *output) {
+    if (output == NULL || strcmp(output, "str") == 0) return HOEP_OUTPUT_STR;
+    if (strcmp(output, "bytes") == 0) return HOEP_OUTPUT_BYTES;
+    
+    PyErr_Format(PyExc_ValueError, "output must be 'str' or 'bytes', not '%s'", output);
+    
+    return -1;
+}
+
+/* Wraps rendered HTML in the requested output type. Bytes are handed out
+ * as they are, without the UTF-8 decode a str needs. */
+static PyObject *html_result(const uint8_t *data, size_t size, int output) {
+    if (output == HOEP_OUTPUT_BYTES) {
+        return PyBytes_FromStringAndSize((const char *) data, (Py_ssize_t) size);
+    }
+    
+    return hoep_str(data, size);
+}
+
+/* Appends rendered HTML to the end of a bytearray. */
+static int html_append(PyObject *target, const uint8_t *data, size_t size) {
+    Py_ssize_t offset = PyByteArray_GET_SIZE(target);
+    
+    
+    if ((size_t) (PY_SSIZE_T_MAX - offset) < size) {
+        PyErr_NoMemory();
+        
+        return -1;
+    }
+    
+    if (PyByteArray_Resize(target, offset + (Py_ssize_t) size) < 0) return -1;
+    
+    if (size > 0) memcpy(PyByteArray_AS_STRING(target) + offset, data, size);
+    
+    return 0;
+}
+
+
+static void references_destroy(PyObject *capsule) {
+    hoedown_references_free(PyCapsule_GetPointer(capsule, HOEP_REFERENCES));
+}
+
+/* Adds the references of a mapping from names to either a url or a
+ * (url, title) pair. */
+static int references_update(hoedown_references *references, PyObject *mapping) {
+    const char *name, *link, *title;
+    Py_ssize_t name_size, link_size, title_size, i;
+    PyObject *items, *value;
+    
+    
+    items = PyMapping_Items(mapping);
+    if (items == NULL) return -1;
+    
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        title = NULL;
+        title_size = 0;
+        
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(items, i), "s#O", &name, &name_size, &value)) goto exc;
+        
+        if (PyTuple_Check(value)) {
+            if (!PyArg_ParseTuple(value, "s#z#", &link, &link_size, &title, &title_size)) goto exc;
+        } else if (PyUnicode_Check(value)) {
+            link = PyUnicode_AsUTF8AndSize(value, &link_size);
+            if (link == NULL) goto exc;
+        } else {
+            PyErr_Format(PyExc_TypeError, "reference must be str or a (url, title) tuple, %s received", Py_TYPE(value)->tp_name);
+            
+            goto exc;
+        }
+        
+        if (!hoedown_references_add(references, (const uint8_t *) name, (size_t) name_size,
+            (const uint8_t *) link, (size_t) link_size, (const uint8_t *) title, (size_t) title_size)) {
+            PyErr_NoMemory();
+            
+            goto exc;
+        }
+    }
+    
+    Py_DECREF(items);
+    
+    return 0;
+    
+    exc:
+        Py_DECREF(items);
+        
+        return -1;
+}
+
+/* Builds the references shared by every render of an instance, either from
+ * Markdown reference definitions or from a mapping. The table is never
+ * changed afterwards, so renders may read it from any thread. */
+static PyObject *references_new(PyObject *definitions) {
+    hoedown_references *references;
+    Py_buffer view;
+    PyObject *capsule;
+    int ret;
+    
+    
+    references = hoedown_references_new();
+    if (references == NULL) return PyErr_NoMemory();
+    
+    if (PyUnicode_Check(definitions) || PyObject_CheckBuffer(definitions)) {
+        if (markdown_buffer(definitions, &view) < 0) goto exc;
+        
+        ret = hoedown_references_parse(references, view.buf, (size_t) view.len);
+        
+        PyBuffer_Release(&view);
+        
+        if (!ret) {
+            PyErr_NoMemory();
+            
+            goto exc;
+        }
+    } else if (!PyMapping_Check(definitions)) {
+        PyErr_Format(PyExc_TypeError, "references must be str, a bytes-like object or a mapping, %s received", Py_TYPE(definitions)->tp_name);
+        
+        goto exc;
+    } else if (references_update(references, definitions) < 0) {
+        goto exc;
+    }
+    
+    capsule = PyCapsule_New(references, HOEP_REFERENCES, references_destroy);
+    if (capsule == NULL) goto exc;
+    
+    return capsule;
+    
+    exc:
+        hoedown_references_free(references);
+        
+        return NULL;
+}
+
+static const hoedown_references *references_table(PyObject *capsule) {
+    return capsule != NULL ? PyCapsule_GetPointer(capsule, HOEP_REFERENCES) : NULL;
+}
+
+
+/* Renders Markdown into *buffer. SmartyPants reads the rendered HTML
+ * straight out of it into *scratch and the two are swapped, so the
+ * result always ends up in *buffer. Safe to call without the GIL. */
+static void render_document(hoedown_document *document, hoedown_buffer **buffer, hoedown_buffer **scratch,
+    const uint8_t *data, size_t size, int smartypants) {
+    hoedown_buffer *swap;
+    
+    
+    /* markdown */
+    hoedown_document_render(document, *buffer, data, size);
+    
+    /* smartypants */
+    if (smartypants) {
+        hoedown_html_smartypants(*scratch, (*buffer)->data, (*buffer)->size);
+        
+        swap = *buffer;
+        *buffer = *scratch;
+        *scratch = swap;
+        
+        (*scratch)->size = 0;
+    }
+}
+
+/* Renders Markdown with the calling thread's cached engine. The HTML stays
+ * in engine->buffer until the engine is released. */
+static hoep_engine *render_engine(PyObject *markdown, unsigned int extensions, unsigned int render_flags) {
+    hoep_engine *engine;
+    int smartypants = (render_flags & HOEP_HTML_SMARTYPANTS) != 0;
+    Py_buffer view;
+    
+    
+    if (markdown_buffer(markdown, &view) < 0) return NULL;
+    
+    engine = hoep_engine_acquire(extensions, render_flags);
+    if (engine == NULL) {
+        PyBuffer_Release(&view);
+        
+        return NULL;
+    }
+    
+    Py_BEGIN_ALLOW_THREADS
+    render_document(engine->document, &engine->buffer, &engine->scratch, view.buf, view.len, smartypants);
+    Py_END_ALLOW_THREADS
+    
+    PyBuffer_Release(&view);
+    
+    return engine;
+}
+
 static PyObject *render(PyObject *self, PyObject *args, PyObject *kwargs) {
-    static char *kwparams[] = {"markdown", "extensions", "render_flags", NULL};
+    static char *kwparams[] = {"markdown", "extensions", "render_flags", "output", NULL};
     
-    hoedown_renderer *renderer;
-    hoedown_document *document;
-    hoedown_buffer *buffer;
+    hoep_engine *engine;
     unsigned int extensions = 0, render_flags = 0;
-    const char *md;
-    const uint8_t *sp;
-    Py_ssize_t md_size, sp_size;
-    PyObject *smartypants, *html;
+    int mode;
+    const char *output = NULL;
+    PyObject *markdown, *html;
     
     
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|II", kwparams, &md, &extensions, &render_flags)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|IIs", kwparams, &markdown, &extensions, &render_flags, &output)) {
         return NULL;
     }
     
-    renderer = hoedown_html_renderer_new(render_flags, 0);
-    document = hoedown_document_new(renderer, extensions, 16);
-    buffer = hoedown_buffer_new(16);
+    if ((mode = output_mode(output)) < 0) return NULL;
     
-    /* markdown */
-    md_size = (Py_ssize_t) strlen(md);
+    engine = render_engine(markdown, extensions, render_flags);
+    if (engine == NULL) return NULL;
     
-    hoedown_document_render(document, buffer, (const uint8_t *) md, md_size);
+    html = html_result(engine->buffer->data, engine->buffer->size, mode);
     
-    /* smartypants */
-    if (render_flags & HOEP_HTML_SMARTYPANTS) {
-        smartypants = PyUnicode_DecodeUTF8((const char *) buffer->data, buffer->size, "strict");
+    hoep_engine_release(engine);
+    
+    return html;
+}
+
+static PyObject *render_into(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"markdown", "target", "extensions", "render_flags", NULL};
+    
+    hoep_engine *engine;
+    unsigned int extensions = 0, render_flags = 0;
+    size_t size;
+    int ret;
+    PyObject *markdown, *target;
+    
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO!|II", kwparams, &markdown, &PyByteArray_Type, &target, &extensions, &render_flags)) {
+        return NULL;
+    }
+    
+    engine = render_engine(markdown, extensions, render_flags);
+    if (engine == NULL) return NULL;
+    
+    size = engine->buffer->size;
+    ret = html_append(target, engine->buffer->data, size);
+    
+    hoep_engine_release(engine);
+    
+    if (ret < 0) return NULL;
+    
+    return PyLong_FromSize_t(size);
+}
+
+static PyObject *clear_cache(PyObject *self, PyObject *unused) {
+    hoep_cache_clear();
+    
+    Py_RETURN_NONE;
+}
+
+
+static int default_threads(void) {
+    PyObject *os, *count;
+    long threads = 1;
+    
+    
+    os = PyImport_ImportModule("os");
+    if (os == NULL) goto exc;
+    
+    count = PyObject_CallMethod(os, "cpu_count", NULL);
+    
+    Py_DECREF(os);
+    
+    if (count == NULL) goto exc;
+    
+    if (count != Py_None) threads = PyLong_AsLong(count);
+    
+    Py_DECREF(count);
+    
+    if (threads < 1) threads = 1;
+    
+    return (int) threads;
+    
+    exc:
+        PyErr_Clear();
         
-        sp = (const uint8_t *) PyUnicode_AsUTF8AndSize(smartypants, &sp_size);
+        return 1;
+}
+
+/* Renders a sequence of Markdown documents across a pool of native threads.
+ * The optional preprocess and postprocess callables are applied to each
+ * document while holding the GIL. */
+static PyObject *render_batch(PyObject *markdowns, unsigned int extensions, unsigned int render_flags, int threads,
+    PyObject *references, PyObject *preprocess, PyObject *postprocess) {
+    hoep_batch_item *items;
+    Py_buffer *views;
+    Py_ssize_t count, exported = 0, i;
+    int ok;
+    PyObject *seq, *inputs = NULL, *markdown, *html, *ret = NULL, *message;
+    
+    
+    seq = PySequence_Fast(markdowns, "markdown must be a sequence of str or bytes-like objects");
+    if (seq == NULL) return NULL;
+    
+    /* preprocess may load other references into the instance */
+    Py_XINCREF(references);
+    
+    count = PySequence_Fast_GET_SIZE(seq);
+    
+    items = PyMem_Calloc(count ? count : 1, sizeof(hoep_batch_item));
+    views = PyMem_Calloc(count ? count : 1, sizeof(Py_buffer));
+    if (items == NULL || views == NULL) {
+        PyErr_NoMemory();
         
-        hoedown_buffer_reset(buffer);
-        hoedown_html_smartypants(buffer, sp, sp_size);
+        goto exc;
+    }
+    
+    ret = PyList_New(count);
+    if (ret == NULL) goto exc;
+    
+    /* preprocess */
+    if (preprocess != NULL) {
+        inputs = PyList_New(count);
+        if (inputs == NULL) goto exc;
+        
+        for (i = 0; i < count; i++) {
+            markdown = markdown_str(PySequence_Fast_GET_ITEM(seq, i));
+            if (markdown == NULL) goto exc;
+            
+            Py_SETREF(markdown, PyObject_CallFunctionObjArgs(preprocess, markdown, NULL));
+            if (markdown == NULL) goto exc;
+            
+            PyList_SET_ITEM(inputs, i, markdown);
+            
+            if (!PyUnicode_Check(markdown)) {
+                message = PyUnicode_FromFormat("must return str, %s received", Py_TYPE(markdown)->tp_name);
+                
+                PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
+                
+                Py_DECREF(message);
+                
+                goto exc;
+            }
+        }
+    }
+    
+    for (; exported < count; exported++) {
+        markdown = inputs ? PyList_GET_ITEM(inputs, exported) : PySequence_Fast_GET_ITEM(seq, exported);
         
-        Py_DECREF(smartypants);
+        if (markdown_buffer(markdown, &views[exported]) < 0) goto exc;
+        
+        items[exported].markdown = views[exported].buf;
+        items[exported].size = (size_t) views[exported].len;
     }
     
-    html = PyUnicode_DecodeUTF8((const char *) buffer->data, buffer->size, "strict");
+    if (threads <= 0) threads = default_threads();
     
-    hoedown_buffer_free(buffer);
-    hoedown_document_free(document);
-    hoedown_html_renderer_free(renderer);
+    /* markdown */
+    Py_BEGIN_ALLOW_THREADS
+    ok = hoep_batch_render(items, (size_t) count, extensions, render_flags,
+        (render_flags & HOEP_HTML_SMARTYPANTS) != 0, references_table(references), threads);
+    Py_END_ALLOW_THREADS
     
-    return html;
+    if (!ok) {
+        PyErr_NoMemory();
+        
+        goto exc;
+    }
+    
+    for (i = 0; i < count; i++) {
+        html = hoep_str(items[i].html->data, items[i].html->size);
+        if (html == NULL) goto exc;
+        
+        /* postprocess */
+        if (postprocess != NULL) {
+            Py_SETREF(html, PyObject_CallFunctionObjArgs(postprocess, html, NULL));
+            if (html == NULL) goto exc;
+            
+            if (!PyUnicode_Check(html)) {
+                message = PyUnicode_FromFormat("must return str, %s received", Py_TYPE(html)->tp_name);
+                
+                PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
+                
+                Py_DECREF(message);
+                Py_DECREF(html);
+                
+                goto exc;
+            }
+        }
+        
+        PyList_SET_ITEM(ret, i, html);
+    }
+    
+    goto cleanup;
+    
+    exc:
+        Py_CLEAR(ret);
+    cleanup:
+        for (i = 0; i < exported; i++) {
+            PyBuffer_Release(&views[i]);
+        }
+        
+        if (items != NULL) {
+            for (i = 0; i < count; i++) {
+                hoedown_buffer_free(items[i].html);
+            }
+        }
+        
+        PyMem_Free(items);
+        PyMem_Free(views);
+        
+        Py_XDECREF(inputs);
+        Py_XDECREF(references);
+        Py_DECREF(seq);
+        
+        return ret;
 }
 
+static PyObject *render_many(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"markdown", "extensions", "render_flags", "threads", NULL};
+    
+    unsigned int extensions = 0, render_flags = 0;
+    int threads = 0;
+    PyObject *markdowns;
+    
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|IIi", kwparams, &markdowns, &extensions, &render_flags, &threads)) {
+        return NULL;
+    }
+    
+    return render_batch(markdowns, extensions, render_flags, threads, NULL, NULL, NULL);
+}
 
-static int Hoep_init(Hoep *self, PyObject *args, PyObject *kwargs) {
-    static char *kwparams[] = {"extensions", "render_flags", NULL};
+
+static PyObject *Hoep_lookup(Hoep *self, const char *name) {
+    PyObject *method;
     
-    hoedown_html_renderer_state *state;
-    void **hd_callbacks, **hp_callbacks;
-    int i;
     
+    method = PyObject_GetAttrString((PyObject *) self, name);
+    if (method == NULL && PyErr_ExceptionMatches(PyExc_AttributeError)) {
+        PyErr_Clear();
+    }
     
-    self->extensions = 0;
-    self->render_flags = 0;
+    return method;
+}
+
+static void Hoep_teardown(Hoep *self) {
+    int i;
     
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|II", kwparams, &self->extensions, &self->render_flags)) {
-        return -1;
+    
+    for (i = 0; i < HOEP_METHOD_COUNT; i++) {
+        Py_CLEAR(self->methods[i]);
     }
     
+    Py_CLEAR(self->preprocess);
+    Py_CLEAR(self->postprocess);
+    
+    if (self->document != NULL) hoedown_document_free(self->document);
+    if (self->renderer != NULL) hoedown_html_renderer_free(self->renderer);
+    
+    self->document = NULL;
+    self->renderer = NULL;
+}
+
+/* Resolves the callback methods once and builds a renderer whose callbacks
+ * point into the wrapper for each one that was found. */
+static int Hoep_setup(Hoep *self) {
+    hoedown_html_renderer_state *state;
+    void **hd_callbacks, **hp_callbacks;
+    int i;
+    
+    
     self->renderer = hoedown_html_renderer_new(self->render_flags, 0);
+    if (self->renderer == NULL) goto exc_memory;
     
     state = self->renderer->opaque;
-    state->opaque = self;
+    state->opaque = self->methods;
     
     hd_callbacks = (void **) self->renderer;
     hp_callbacks = (void **) &hoep_callbacks;
     
+    /* Without any overridden callbacks nothing calls back into Python
+     * while rendering, so the GIL can be released. */
+    self->native = 1;
+    
     for (i = 0; method_names[i] != NULL; i++) {
-        if (PyObject_HasAttrString((PyObject *) self, (const char *) method_names[i])) {
+        self->methods[i] = Hoep_lookup(self, method_names[i]);
+        
+        if (self->methods[i] != NULL) {
             hd_callbacks[i + 1] = hp_callbacks[i + 1];
+            
+            self->native = 0;
+        } else if (PyErr_Occurred()) {
+            return -1;
         }
     }
     
+    self->preprocess = Hoep_lookup(self, "preprocess");
+    if (self->preprocess == NULL && PyErr_Occurred()) return -1;
+    
+    self->postprocess = Hoep_lookup(self, "postprocess");
+    if (self->postprocess == NULL && PyErr_Occurred()) return -1;
+    
     self->document = hoedown_document_new(self->renderer, self->extensions, 16);
-    self->buffer = hoedown_buffer_new(16);
+    if (self->document == NULL) goto exc_memory;
+    
+    hoedown_document_set_references(self->document, references_table(self->references));
     
     return 0;
+    
+    exc_memory:
+        PyErr_NoMemory();
+        
+        return -1;
 }
 
-static PyObject *Hoep_render(Hoep *self, PyObject *args) {
-    const char *str;
-    const uint8_t *md, *sp;
-    Py_ssize_t str_size, md_size, sp_size;
-    PyObject *markdown, *smartypants, *html, *message;
+static int Hoep_init(Hoep *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"extensions", "render_flags", "buffer_limit", "shrink_ratio", "references", NULL};
+    
+    int i;
+    PyObject *definitions = NULL, *references = NULL;
     
     
-    if (!PyArg_ParseTuple(args, "s", &str)) {
+    self->extensions = 0;
+    self->render_flags = 0;
+    self->buffer_limit = HOEP_BUFFER_LIMIT;
+    self->shrink_ratio = HOEP_SHRINK_RATIO;
+    self->average = 0;
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|IInnO", kwparams, &self->extensions, &self->render_flags,
+        &self->buffer_limit, &self->shrink_ratio, &definitions)) {
+        return -1;
+    }
+    
+    if (definitions != NULL && definitions != Py_None) {
+        references = references_new(definitions);
+        if (references == NULL) return -1;
+    }
+    
+    if (self->lock == NULL) {
+        self->lock = PyThread_allocate_lock();
+        if (self->lock == NULL) {
+            Py_XDECREF(references);
+            
+            PyErr_NoMemory();
+            
+            return -1;
+        }
+    }
+    
+    if (Hoep_acquire(self) < 0) {
+        Py_XDECREF(references);
+        
+        return -1;
+    }
+    
+    Hoep_teardown(self);
+    
+    Py_XSETREF(self->references, references);
+    
+    if (self->buffer == NULL) self->buffer = hoedown_buffer_new(16);
+    if (self->scratch == NULL) self->scratch = hoedown_buffer_new(16);
+    
+    i = Hoep_setup(self);
+    
+    Hoep_release(self);
+    
+    return i;
+}
+
+static PyObject *Hoep_refresh(Hoep *self, PyObject *unused) {
+    int ret;
+    
+    
+    if (Hoep_acquire(self) < 0) return NULL;
+    
+    Hoep_teardown(self);
+    
+    ret = Hoep_setup(self);
+    
+    Hoep_release(self);
+    
+    if (ret < 0) return NULL;
+    
+    Py_RETURN_NONE;
+}
+
+/* Replaces the shared references. Batches that are still rendering hold
+ * on to the table they started with. */
+static PyObject *Hoep_load_references(Hoep *self, PyObject *definitions) {
+    PyObject *references = NULL;
+    
+    
+    if (definitions != Py_None) {
+        references = references_new(definitions);
+        if (references == NULL) return NULL;
+    }
+    
+    if (Hoep_acquire(self) < 0) {
+        Py_XDECREF(references);
+        
         return NULL;
     }
     
-    str_size = (Py_ssize_t) strlen(str);
+    Py_XSETREF(self->references, references);
+    
+    if (self->document != NULL) hoedown_document_set_references(self->document, references_table(references));
+    
+    Hoep_release(self);
+    
+    Py_RETURN_NONE;
+}
+
+/* Renders Markdown into the instance buffer. On success the instance
+ * lock is held until Hoep_finish() is called. */
+static int Hoep_render_buffer(Hoep *self, PyObject *input) {
+    int smartypants = (self->render_flags & HOEP_HTML_SMARTYPANTS) != 0;
+    Py_buffer view;
+    PyObject *markdown = NULL, *message;
+    
     
     /* preprocess */
-    if (PyObject_HasAttrString((PyObject *) self, "preprocess")) {
-        markdown = PyObject_CallMethod((PyObject *) self, "preprocess", "(s)", str);
-        if (markdown == NULL) return NULL;
+    if (self->preprocess != NULL) {
+        markdown = markdown_str(input);
+        if (markdown == NULL) return -1;
+        
+        Py_SETREF(markdown, PyObject_CallFunctionObjArgs(self->preprocess, markdown, NULL));
+        if (markdown == NULL) return -1;
         if (!PyUnicode_Check(markdown)) goto exc_pre;
         
-        md = (const uint8_t *) PyUnicode_AsUTF8AndSize(markdown, &md_size);
+        input = markdown;
+    }
+    
+    if (markdown_buffer(input, &view) < 0) goto exc_input;
+    
+    if (Hoep_acquire(self) < 0) goto exc_lock;
+    
+    if (self->native) {
+        Py_BEGIN_ALLOW_THREADS
+        render_document(self->document, &self->buffer, &self->scratch, view.buf, view.len, smartypants);
+        Py_END_ALLOW_THREADS
+    } else {
+        render_document(self->document, &self->buffer, &self->scratch, view.buf, view.len, smartypants);
+    }
+    
+    PyBuffer_Release(&view);
+    Py_XDECREF(markdown);
+    
+    return 0;
+    
+    exc_lock:
+        PyBuffer_Release(&view);
+    exc_input:
+        Py_XDECREF(markdown);
         
-        hoedown_document_render(self->document, self->buffer, (const uint8_t *) md, md_size);
+        return -1;
+    exc_pre:
+        message = PyUnicode_FromFormat("must return str, %s received", Py_TYPE(markdown)->tp_name);
+        
+        PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
         
+        Py_DECREF(message);
         Py_DECREF(markdown);
-    } else {
-        hoedown_document_render(self->document, self->buffer, (const uint8_t *) str, str_size);
+        
+        return -1;
+}
+
+/* Empties a buffer but keeps its storage, unless it has to be trimmed back
+ * down to `keep` bytes. */
+static void buffer_trim(hoedown_buffer *buffer, size_t limit, size_t keep, int trim) {
+    buffer->size = 0;
+    
+    if (buffer->asize > limit || (trim && buffer->asize > keep)) {
+        hoedown_buffer_reset(buffer);
+        
+        if (keep > 0) hoedown_buffer_grow(buffer, keep);
     }
+}
+
+/* The output buffers keep their capacity between renders, so steady-state
+ * rendering does not allocate. Storage past buffer_limit is given back, as
+ * is the storage left over by a render that produced shrink_ratio times the
+ * running average output size. */
+static void Hoep_finish(Hoep *self) {
+    size_t size = self->buffer->size, average = self->average, limit, keep;
+    int trim;
     
-    /* smartypants */
-    if (self->render_flags & HOEP_HTML_SMARTYPANTS) {
-        smartypants = PyUnicode_DecodeUTF8((const char *) self->buffer->data, self->buffer->size, "strict");
+    
+    limit = self->buffer_limit > 0 ? (size_t) self->buffer_limit : 0;
+    trim = self->shrink_ratio > 0 && average > 0 && size / (size_t) self->shrink_ratio > average;
+    
+    self->average = average > 0 ? average - average / 8 + size / 8 : size;
+    
+    keep = self->average * 2 < limit ? self->average * 2 : limit;
+    
+    buffer_trim(self->buffer, limit, keep, trim);
+    buffer_trim(self->scratch, limit, keep, trim);
+    
+    Hoep_release(self);
+}
+
+/* Hands the instance buffer to the postprocess callback. */
+static PyObject *Hoep_postprocess(Hoep *self) {
+    PyObject *html, *message;
+    
+    
+    html = PyObject_CallFunction(self->postprocess, "(s#)", self->buffer->data, (Py_ssize_t) self->buffer->size);
+    if (html == NULL) return NULL;
+    
+    if (!PyUnicode_Check(html)) {
+        message = PyUnicode_FromFormat("must return str, %s received", Py_TYPE(html)->tp_name);
         
-        sp = (const uint8_t *) PyUnicode_AsUTF8AndSize(smartypants, &sp_size);
+        PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
         
-        hoedown_buffer_reset(self->buffer);
-        hoedown_html_smartypants(self->buffer, sp, sp_size);
+        Py_DECREF(message);
+        Py_DECREF(html);
         
-        Py_DECREF(smartypants);
+        return NULL;
+    }
+    
+    return html;
+}
+
+static PyObject *Hoep_render(Hoep *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"markdown", "output", NULL};
+    
+    int mode;
+    const char *output = NULL;
+    PyObject *input, *html;
+    
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|s", kwparams, &input, &output)) {
+        return NULL;
     }
     
+    if ((mode = output_mode(output)) < 0) return NULL;
+    
+    if (Hoep_render_buffer(self, input) < 0) return NULL;
+    
     /* postprocess */
-    if (PyObject_HasAttrString((PyObject *) self, "postprocess")) {
-        html = PyObject_CallMethod((PyObject *) self, "postprocess", "(s)", self->buffer->data);
-        if (html == NULL) return NULL;
-        if (!PyUnicode_Check(html)) goto exc_post;
+    if (self->postprocess != NULL) {
+        html = Hoep_postprocess(self);
+        
+        if (html != NULL && mode == HOEP_OUTPUT_BYTES) {
+            Py_SETREF(html, PyUnicode_AsUTF8String(html));
+        }
     } else {
-        html = PyUnicode_DecodeUTF8((const char *) self->buffer->data, self->buffer->size, "strict");
+        html = html_result(self->buffer->data, self->buffer->size, mode);
     }
     
-    hoedown_buffer_reset(self->buffer);
+    Hoep_finish(self);
     
     return html;
+}
+
+static PyObject *Hoep_render_into(Hoep *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"markdown", "target", NULL};
     
-    exc_post:;
-        message = PyUnicode_FromFormat("must return str, %s received", Py_TYPE(html)->tp_name);
-        
-        PyErr_SetString(PyExc_TypeError, PyUnicode_AsUTF8(message));
+    const char *data;
+    Py_ssize_t size;
+    int ret;
+    PyObject *input, *target, *html = NULL;
+    
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO!", kwparams, &input, &PyByteArray_Type, &target)) {
+        return NULL;
+    }
+    
+    if (Hoep_render_buffer(self, input) < 0) return NULL;
+    
+    /* postprocess */
+    if (self->postprocess != NULL) {
+        html = Hoep_postprocess(self);
+        if (html == NULL) goto exc;
         
-        hoedown_buffer_reset(self->buffer);
+        data = PyUnicode_AsUTF8AndSize(html, &size);
+        if (data == NULL) goto exc;
+    } else {
+        data = (const char *) self->buffer->data;
+        size = (Py_ssize_t) self->buffer->size;
+    }
+    
+    ret = html_append(target, (const uint8_t *) data, (size_t) size);
+    
+    Py_XDECREF(html);
+    
+    Hoep_finish(self);
+    
+    if (ret < 0) return NULL;
+    
+    return PyLong_FromSsize_t(size);
+    
+    exc:
+        Py_XDECREF(html);
         
-        Py_DECREF(message);
-        Py_DECREF(html);
+        Hoep_finish(self);
         
         return NULL;
-    exc_pre:
-        Py_DECREF(markdown);
+}
+
+static PyObject *Hoep_render_many(Hoep *self, PyObject *args, PyObject *kwargs) {
+    static char *kwparams[] = {"markdown", "threads", NULL};
+    
+    Py_ssize_t count, i;
+    int threads = 0;
+    PyObject *markdowns, *seq, *html, *ret;
+    
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwparams, &markdowns, &threads)) {
+        return NULL;
+    }
+    
+    if (self->native) {
+        return render_batch(markdowns, self->extensions, self->render_flags, threads, self->references,
+            self->preprocess, self->postprocess);
+    }
+    
+    /* Python callbacks need the GIL, so there is nothing to gain from
+     * rendering in parallel. */
+    seq = PySequence_Fast(markdowns, "markdown must be a sequence of str");
+    if (seq == NULL) return NULL;
+    
+    count = PySequence_Fast_GET_SIZE(seq);
+    
+    ret = PyList_New(count);
+    if (ret == NULL) goto exc;
+    
+    for (i = 0; i < count; i++) {
+        html = PyObject_CallMethod((PyObject *) self, "render", "(O)", PySequence_Fast_GET_ITEM(seq, i));
+        if (html == NULL) goto exc;
+        
+        PyList_SET_ITEM(ret, i, html);
+    }
+    
+    Py_DECREF(seq);
+    
+    return ret;
+    
+    exc:
+        Py_XDECREF(ret);
+        Py_DECREF(seq);
         
         return NULL;
 }
 
+static int Hoep_traverse(Hoep *self, visitproc visit, void *arg) {
+    int i;
+    
+    
+    for (i = 0; i < HOEP_METHOD_COUNT; i++) {
+        Py_VISIT(self->methods[i]);
+    }
+    
+    Py_VISIT(self->preprocess);
+    Py_VISIT(self->postprocess);
+    
+    return 0;
+}
+
+/* Cached methods are bound to the instance, so they only need to be dropped
+ * to break the reference cycle; the renderer keeps its callbacks. */
+static int Hoep_clear(Hoep *self) {
+    int i;
+    
+    
+    for (i = 0; i < HOEP_METHOD_COUNT; i++) {
+        Py_CLEAR(self->methods[i]);
+    }
+    
+    Py_CLEAR(self->preprocess);
+    Py_CLEAR(self->postprocess);
+    
+    return 0;
+}
+
 static void Hoep_dealloc(Hoep *self) {
+    PyObject_GC_UnTrack(self);
+    
+    Hoep_teardown(self);
+    
     hoedown_buffer_free(self->buffer);
-    if (self->document != NULL) hoedown_document_free(self->document);
-    if (self->renderer != NULL) hoedown_html_renderer_free(self->renderer);
+    hoedown_buffer_free(self->scratch);
+    Py_CLEAR(self->references);
+    if (self->lock != NULL) PyThread_free_lock(self->lock);
     
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
@@ -184,17 +1006,26 @@ static void Hoep_dealloc(Hoep *self) {
 
 static PyMethodDef module_functions[] = {
     {"render", (PyCFunction) render, METH_VARARGS | METH_KEYWORDS, "Render Markdown."},
+    {"render_into", (PyCFunction) render_into, METH_VARARGS | METH_KEYWORDS, "Render Markdown and append the UTF-8 HTML to a bytearray."},
+    {"render_many", (PyCFunction) render_many, METH_VARARGS | METH_KEYWORDS, "Render a sequence of Markdown documents in parallel."},
+    {"clear_cache", (PyCFunction) clear_cache, METH_NOARGS, "Drop the renderers cached by the render functions."},
     {NULL, NULL, 0, NULL}
 };
 
 static PyMemberDef Hoep_members[] = {
     {"extensions", T_UINT, offsetof(Hoep, extensions), READONLY, "Markdown extension bit flags."},
     {"render_flags", T_UINT, offsetof(Hoep, render_flags), READONLY, "HTML renderer bit flags."},
+    {"buffer_limit", T_PYSSIZET, offsetof(Hoep, buffer_limit), 0, "Most output buffer bytes kept between renders."},
+    {"shrink_ratio", T_PYSSIZET, offsetof(Hoep, shrink_ratio), 0, "Output size, relative to the running average, after which buffers are trimmed."},
     {NULL}
 };
 
 static PyMethodDef Hoep_methods[] = {
-    {"render", (PyCFunction) Hoep_render, METH_VARARGS, "Render Markdown."},
+    {"render", (PyCFunction) Hoep_render, METH_VARARGS | METH_KEYWORDS, "Render Markdown."},
+    {"render_into", (PyCFunction) Hoep_render_into, METH_VARARGS | METH_KEYWORDS, "Render Markdown and append the UTF-8 HTML to a bytearray."},
+    {"render_many", (PyCFunction) Hoep_render_many, METH_VARARGS | METH_KEYWORDS, "Render a sequence of Markdown documents in parallel."},
+    {"refresh", (PyCFunction) Hoep_refresh, METH_NOARGS, "Resolve the callback methods again."},
+    {"load_references", (PyCFunction) Hoep_load_references, METH_O, "Replace the link references shared by every render."},
     {NULL}
 };
 
@@ -218,10 +1049,11 @@ static PyTypeObject HoepType = {
     0,                                          /* tp_getattro */
     0,                                          /* tp_setattro */
     0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,   /* tp_flags */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+        Py_TPFLAGS_HAVE_GC,                     /* tp_flags */
     "Hoedown's HTML renderer.",                 /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
+    (traverseproc) Hoep_traverse,               /* tp_traverse */
+    (inquiry) Hoep_clear,                       /* tp_clear */
     0,                                          /* tp_richcompare */
     0,                                          /* tp_weaklistoffset */
     0,                                          /* tp_iter */
@@ -252,9 +1084,21 @@ static PyModuleDef hoep_module = {
 };
 
 
+/* hoedown allocates through the raw Python allocator, which does not need
+ * the GIL, so its memory shows up in tracemalloc. */
+static const hoedown_allocator raw_allocator = {
+    PyMem_RawMalloc,
+    PyMem_RawCalloc,
+    PyMem_RawRealloc,
+    PyMem_RawFree
+};
+
+
 PyMODINIT_FUNC PyInit_hoep(void) {
     PyObject *mod;
     
+    hoedown_set_allocator(&raw_allocator);
+    
     HoepType.tp_new = PyType_GenericNew;
     if (PyType_Ready(&HoepType) < 0) return NULL;
     
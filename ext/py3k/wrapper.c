@@ -1,41 +1,137 @@
-#include <Python.h>
+#define PY_SSIZE_T_CLEAN
 
-#include <stdarg.h>
+#include <Python.h>
 
 #include "../hoedown/html.h"
 
+#include "wrapper.h"
+
+
+#if PY_VERSION_HEX >= 0x03090000
+#define HOEP_VECTORCALL PyObject_Vectorcall
+#elif PY_VERSION_HEX >= 0x03080000
+#define HOEP_VECTORCALL _PyObject_Vectorcall
+#endif
+
+#define HOEP_MAX_ARGS 3
 
-static PyObject *call_method(void *opaque, const char *method_name, const char *format, va_list va_args) {
-    PyObject *self, *method, *args;
+
+/* Checks a word at a time whether any byte has its high bit set. */
+static int is_ascii(const uint8_t *data, size_t size) {
+    const size_t mask = (size_t) 0x8080808080808080ULL;
+    size_t word, acc = 0, i = 0;
+    
+    
+    for (; i + 4 * sizeof(size_t) <= size; i += 4 * sizeof(size_t)) {
+        memcpy(&word, data + i, sizeof(size_t));
+        acc |= word;
+        memcpy(&word, data + i + sizeof(size_t), sizeof(size_t));
+        acc |= word;
+        memcpy(&word, data + i + 2 * sizeof(size_t), sizeof(size_t));
+        acc |= word;
+        memcpy(&word, data + i + 3 * sizeof(size_t), sizeof(size_t));
+        acc |= word;
+        
+        if (acc & mask) return 0;
+    }
     
+    for (; i < size; i++) {
+        acc |= data[i];
+    }
     
-    self = ((hoedown_html_renderer_state *) opaque)->opaque;
+    return (acc & mask) == 0;
+}
+
+/* Builds a str from UTF-8. Pure ASCII, the common case for HTML, is
+ * copied straight into a compact str without going through the decoder. */
+PyObject *hoep_str(const uint8_t *data, size_t size) {
+    PyObject *str;
     
-    method = PyObject_GetAttrString(self, method_name);
-    if (method == NULL) return NULL;
     
-    args = Py_VaBuildValue(format, va_args);
-    if (args == NULL) goto exc;
+    if (!is_ascii(data, size)) {
+        return PyUnicode_DecodeUTF8((const char *) data, (Py_ssize_t) size, "strict");
+    }
     
-    return PyObject_CallObject(method, args);
+    str = PyUnicode_New((Py_ssize_t) size, 127);
+    if (str == NULL) return NULL;
     
-    exc:
-        Py_DECREF(method);
-        
-        return NULL;
+    if (size > 0) memcpy(PyUnicode_1BYTE_DATA(str), data, size);
+    
+    return str;
 }
 
-static int process(void *opaque, hoedown_buffer *buffer, const char *method_name, const char *format, ...) {
-    va_list va_args;
-    PyObject *ret, *exc, *message;
+
+static PyObject *to_str(const hoedown_buffer *buffer) {
+    if (!buffer) {
+        return PyUnicode_FromStringAndSize(NULL, 0);
+    }
+    
+    return hoep_str(buffer->data, buffer->size);
+}
+
+static PyObject *to_str_or_none(const hoedown_buffer *buffer) {
+    if (!buffer) {
+        Py_RETURN_NONE;
+    }
+    
+    return hoep_str(buffer->data, buffer->size);
+}
+
+
+/* The renderer state points at the instance's table of methods, resolved
+ * once when the instance is set up. Steals the references in args. */
+static PyObject *call_method(void *opaque, hoep_method method, PyObject **args, Py_ssize_t nargs) {
+    PyObject **methods, *ret = NULL;
+    Py_ssize_t i;
+#ifdef HOEP_VECTORCALL
+    /* A spare leading slot lets bound methods prepend self in place. */
+    PyObject *stack[HOEP_MAX_ARGS + 1] = {NULL};
+#else
+    PyObject *tuple;
+#endif
     
     
-    va_start(va_args, format);
+    methods = ((hoedown_html_renderer_state *) opaque)->opaque;
     
-    ret = call_method(opaque, method_name, format, va_args);
+    for (i = 0; i < nargs; i++) {
+        if (args[i] == NULL) goto cleanup;
+    }
+    
+#ifdef HOEP_VECTORCALL
+    for (i = 0; i < nargs; i++) {
+        stack[i + 1] = args[i];
+    }
+    
+    ret = HOEP_VECTORCALL(methods[method], stack + 1, (size_t) nargs | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+#else
+    tuple = PyTuple_New(nargs);
+    if (tuple == NULL) goto cleanup;
+    
+    for (i = 0; i < nargs; i++) {
+        Py_INCREF(args[i]);
+        PyTuple_SET_ITEM(tuple, i, args[i]);
+    }
+    
+    ret = PyObject_Call(methods[method], tuple, NULL);
+    
+    Py_DECREF(tuple);
+#endif
+    
+    cleanup:
+        for (i = 0; i < nargs; i++) {
+            Py_XDECREF(args[i]);
+        }
+        
+        return ret;
+}
+
+static int process(void *opaque, hoedown_buffer *buffer, hoep_method method, PyObject **args, Py_ssize_t nargs) {
+    const char *html;
+    Py_ssize_t html_size;
+    PyObject *ret, *exc, *message;
     
-    va_end(va_args);
     
+    ret = call_method(opaque, method, args, nargs);
     if (ret == NULL) goto exc;
     
     if (!PyUnicode_Check(ret)) {
@@ -48,7 +144,10 @@ static int process(void *opaque, hoedown_buffer *buffer, const char *method_name
         goto exc_ret;
     }
     
-    hoedown_buffer_puts(buffer, PyUnicode_AsUTF8(ret));
+    html = PyUnicode_AsUTF8AndSize(ret, &html_size);
+    if (html == NULL) goto exc_ret;
+    
+    hoedown_buffer_put(buffer, html, (size_t) html_size);
     
     Py_DECREF(ret);
     
@@ -68,220 +167,193 @@ static int process(void *opaque, hoedown_buffer *buffer, const char *method_name
 
 /* Block level callbacks. */
 static void hoep_block_code(hoedown_buffer *buffer, const hoedown_buffer *text, const hoedown_buffer *language, void *opaque) {
-    if (!language) {
-        process(opaque, buffer, "block_code", "(s#s)",
-            text->data, text->size,
-            NULL);
-    } else {
-        process(opaque, buffer, "block_code", "(s#s#)",
-            text->data, text->size,
-            language->data, language->size);
-    }
+    PyObject *args[] = {to_str(text), to_str_or_none(language)};
+    
+    process(opaque, buffer, HOEP_BLOCK_CODE, args, 2);
 }
 
 static void hoep_block_html(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "block_html", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_BLOCK_HTML, args, 1);
 }
 
 static void hoep_block_quote(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "block_quote", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_BLOCK_QUOTE, args, 1);
 }
 
 static void hoep_footnotes(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "footnotes", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_FOOTNOTES, args, 1);
 }
 
 static void hoep_footnote_def(hoedown_buffer *buffer, const hoedown_buffer *text, unsigned int number, void *opaque) {
-    process(opaque, buffer, "footnote_def", "(s#i)",
-        text->data, text->size,
-        number);
+    PyObject *args[] = {to_str(text), PyLong_FromUnsignedLong(number)};
+    
+    process(opaque, buffer, HOEP_FOOTNOTE_DEF, args, 2);
 }
 
 static void hoep_header(hoedown_buffer *buffer, const hoedown_buffer *text, int level, void *opaque) {
-    process(opaque, buffer, "header", "(s#i)",
-        text->data, text->size,
-        level);
+    PyObject *args[] = {to_str(text), PyLong_FromLong(level)};
+    
+    process(opaque, buffer, HOEP_HEADER, args, 2);
 }
 
 static void hoep_hrule(hoedown_buffer *buffer, void *opaque) {
-    process(opaque, buffer, "hrule", "()");
+    process(opaque, buffer, HOEP_HRULE, NULL, 0);
 }
 
 static void hoep_list(hoedown_buffer *buffer, const hoedown_buffer *text, unsigned int flags, void *opaque) {
-    PyObject *ordered;
+    PyObject *args[] = {to_str(text), PyBool_FromLong(flags & HOEDOWN_LIST_ORDERED)};
     
-    
-    ordered = flags & HOEDOWN_LIST_ORDERED ? Py_True : Py_False;
-    
-    process(opaque, buffer, "list", "(s#O)",
-        text->data, text->size,
-        ordered);
-    
-    Py_DECREF(ordered);
+    process(opaque, buffer, HOEP_LIST, args, 2);
 }
 
 static void hoep_list_item(hoedown_buffer *buffer, const hoedown_buffer *text, unsigned int flags, void *opaque) {
-    PyObject *ordered;
-    
-    
-    ordered = flags & HOEDOWN_LIST_ORDERED ? Py_True : Py_False;
+    PyObject *args[] = {to_str(text), PyBool_FromLong(flags & HOEDOWN_LIST_ORDERED)};
     
-    process(opaque, buffer, "list_item", "(s#O)",
-        text->data, text->size,
-        ordered);
-    
-    Py_DECREF(ordered);
+    process(opaque, buffer, HOEP_LIST_ITEM, args, 2);
 }
 
 static void hoep_paragraph(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "paragraph", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_PARAGRAPH, args, 1);
 }
 
 static void hoep_table(hoedown_buffer *buffer, const hoedown_buffer *header, const hoedown_buffer *body, void *opaque) {
-    process(opaque, buffer, "table", "(s#s#)",
-        header->data, header->size,
-        body->data, body->size);
+    PyObject *args[] = {to_str(header), to_str(body)};
+    
+    process(opaque, buffer, HOEP_TABLE, args, 2);
 }
 
 static void hoep_table_row(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "table_row", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_TABLE_ROW, args, 1);
 }
 
 static void hoep_table_cell(hoedown_buffer *buffer, const hoedown_buffer *text, unsigned int flags, void *opaque) {
-    process(opaque, buffer, "table_cell", "(s#i)",
-        text->data, text->size,
-        flags);
+    PyObject *args[] = {to_str(text), PyLong_FromUnsignedLong(flags)};
+    
+    process(opaque, buffer, HOEP_TABLE_CELL, args, 2);
 }
 
 
 /* Span level callbacks. */
 static int hoep_autolink(hoedown_buffer *buffer, const hoedown_buffer *link, enum hoedown_autolink type, void *opaque) {
-    PyObject *is_email;
-    int ret;
+    PyObject *args[] = {to_str(link), PyBool_FromLong(type == HOEDOWN_AUTOLINK_EMAIL)};
     
-    
-    is_email = type == HOEDOWN_AUTOLINK_EMAIL ? Py_True : Py_False;
-    
-    ret = process(opaque, buffer, "autolink", "(s#O)",
-        link->data, link->size,
-        is_email);
-    
-    Py_DECREF(is_email);
-    
-    return ret;
+    return process(opaque, buffer, HOEP_AUTOLINK, args, 2);
 }
 
 static int hoep_codespan(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "codespan", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_CODESPAN, args, 1);
 }
 
 static int hoep_double_emphasis(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "double_emphasis", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_DOUBLE_EMPHASIS, args, 1);
 }
 
 static int hoep_emphasis(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "emphasis", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_EMPHASIS, args, 1);
 }
 
 static int hoep_footnote_ref(hoedown_buffer *buffer, unsigned int number, void *opaque) {
-    return process(opaque, buffer, "footnote_ref", "(i)", number);
+    PyObject *args[] = {PyLong_FromUnsignedLong(number)};
+    
+    return process(opaque, buffer, HOEP_FOOTNOTE_REF, args, 1);
 }
 
 static int hoep_highlight(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "highlight", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_HIGHLIGHT, args, 1);
 }
 
 static int hoep_image(hoedown_buffer *buffer, const hoedown_buffer *link, const hoedown_buffer *title, const hoedown_buffer *alt, void *opaque) {
-    if (!title) {
-        return process(opaque, buffer, "image", "(s#ss#)",
-            link->data, link->size,
-            NULL,
-            alt->data, alt->size);
-    }
+    PyObject *args[] = {to_str(link), to_str_or_none(title), to_str(alt)};
     
-    return process(opaque, buffer, "image", "(s#s#s#)",
-        link->data, link->size,
-        title->data, title->size,
-        alt->data, alt->size);
+    return process(opaque, buffer, HOEP_IMAGE, args, 3);
 }
 
 static int hoep_line_break(hoedown_buffer *buffer, void *opaque) {
-    return process(opaque, buffer, "line_break", "()");
+    return process(opaque, buffer, HOEP_LINE_BREAK, NULL, 0);
 }
 
 static int hoep_link(hoedown_buffer *buffer, const hoedown_buffer *link, const hoedown_buffer *title, const hoedown_buffer *content, void *opaque) {
-    if (!title) {
-        return process(opaque, buffer, "link", "(s#ss#)",
-            link->data, link->size,
-            NULL,
-            content->data, content->size);
-    }
+    PyObject *args[] = {to_str(link), to_str_or_none(title), to_str(content)};
     
-    return process(opaque, buffer, "link", "(s#s#s#)",
-        link->data, link->size,
-        title->data, title->size,
-        content->data, content->size);
+    return process(opaque, buffer, HOEP_LINK, args, 3);
 }
 
 static int hoep_quote(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "quote", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_QUOTE, args, 1);
 }
 
 static int hoep_raw_html_tag(hoedown_buffer *buffer, const hoedown_buffer *tag, void *opaque) {
-    return process(opaque, buffer, "raw_html_tag", "(s#)",
-        tag->data, tag->size);
+    PyObject *args[] = {to_str(tag)};
+    
+    return process(opaque, buffer, HOEP_RAW_HTML_TAG, args, 1);
 }
 
 static int hoep_strikethrough(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "strikethrough", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_STRIKETHROUGH, args, 1);
 }
 
 static int hoep_superscript(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "superscript", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_SUPERSCRIPT, args, 1);
 }
 
 static int hoep_triple_emphasis(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "triple_emphasis", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_TRIPLE_EMPHASIS, args, 1);
 }
 
 static int hoep_underline(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    return process(opaque, buffer, "underline", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    return process(opaque, buffer, HOEP_UNDERLINE, args, 1);
 }
 
 
 /* Low-level callbacks. */
 static void hoep_entity(hoedown_buffer *buffer, const hoedown_buffer *entity, void *opaque) {
-    process(opaque, buffer, "entity", "(s#)",
-        entity->data, entity->size);
+    PyObject *args[] = {to_str(entity)};
+    
+    process(opaque, buffer, HOEP_ENTITY, args, 1);
 }
 
 static void hoep_normal_text(hoedown_buffer *buffer, const hoedown_buffer *text, void *opaque) {
-    process(opaque, buffer, "normal_text", "(s#)",
-        text->data, text->size);
+    PyObject *args[] = {to_str(text)};
+    
+    process(opaque, buffer, HOEP_NORMAL_TEXT, args, 1);
 }
 
 
 /* Header and footer callbacks. */
 static void hoep_doc_header(hoedown_buffer *buffer, void *opaque) {
-    process(opaque, buffer, "doc_header", "()");
+    process(opaque, buffer, HOEP_DOC_HEADER, NULL, 0);
 }
 
 static void hoep_doc_footer(hoedown_buffer *buffer, void *opaque) {
-    process(opaque, buffer, "doc_footer", "()");
+    process(opaque, buffer, HOEP_DOC_FOOTER, NULL, 0);
 }
 
 
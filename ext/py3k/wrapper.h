@@ -1,5 +1,50 @@
 #include "../hoedown/html.h"
 
 
+/* Slots of the per-instance method table, in the order of method_names. */
+typedef enum {
+    HOEP_BLOCK_CODE,
+    HOEP_BLOCK_QUOTE,
+    HOEP_BLOCK_HTML,
+    HOEP_HEADER,
+    HOEP_HRULE,
+    HOEP_LIST,
+    HOEP_LIST_ITEM,
+    HOEP_PARAGRAPH,
+    HOEP_TABLE,
+    HOEP_TABLE_ROW,
+    HOEP_TABLE_CELL,
+    HOEP_FOOTNOTES,
+    HOEP_FOOTNOTE_DEF,
+    
+    HOEP_AUTOLINK,
+    HOEP_CODESPAN,
+    HOEP_DOUBLE_EMPHASIS,
+    HOEP_EMPHASIS,
+    HOEP_UNDERLINE,
+    HOEP_HIGHLIGHT,
+    HOEP_QUOTE,
+    HOEP_IMAGE,
+    HOEP_LINE_BREAK,
+    HOEP_LINK,
+    HOEP_RAW_HTML_TAG,
+    HOEP_TRIPLE_EMPHASIS,
+    HOEP_STRIKETHROUGH,
+    HOEP_SUPERSCRIPT,
+    HOEP_FOOTNOTE_REF,
+    
+    HOEP_ENTITY,
+    HOEP_NORMAL_TEXT,
+    
+    HOEP_DOC_HEADER,
+    HOEP_DOC_FOOTER,
+    
+    HOEP_METHOD_COUNT
+} hoep_method;
+
+
 extern struct hoedown_renderer hoep_callbacks;
 extern const char *method_names[];
+
+
+PyObject *hoep_str(const uint8_t *data, size_t size);
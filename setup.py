@@ -20,6 +20,8 @@ Unicode
 
 Hoep only accepts and returns ``unicode`` objects in Python 2 and ``str`` objects in Python 3. This goes for custom renderers as well. All callbacks receive and must return ``unicode`` or ``str`` objects, respective to the Python version.
 
+In Python 3, ``render`` and ``render_many`` also accept UTF-8 encoded bytes-like objects (``bytes``, ``bytearray``, ``memoryview``, ``mmap``, ...) as input. These are rendered in place without being copied. The returned HTML is still a ``str``.
+
 
 Basic Usage
 -----------
@@ -48,6 +50,48 @@ Using Hoep is pretty straightforward. You can either use the ``render`` module f
 
     html = md.render('Some ~~bold~~ __"strong"__ text.')
 
+Rendering does not hold the GIL unless a custom renderer overrides callbacks, so documents can be rendered from multiple threads in parallel.
+
+In Python 3, the ``render`` function keeps up to four renderers per thread, one for each combination of extensions and render flags it has seen most recently, so repeated calls skip the setup. ``h.clear_cache()`` drops them.
+
+A ``Hoep`` instance keeps the storage of its output buffer between renders, so rendering documents of a similar size does not allocate. Up to ``buffer_limit`` bytes (4 MiB by default) are kept. After a render whose output was ``shrink_ratio`` times (10 by default) the running average, the buffer is trimmed back. Both can be passed to ``Hoep`` or set as attributes; a ``buffer_limit`` of 0 frees the buffer after every render. Memory used while rendering is allocated through ``PyMem_RawMalloc``, so it shows up in ``tracemalloc``.
+
+Batch rendering
+~~~~~~~~~~~~~~~
+
+To render many documents at once in Python 3, pass a list of them to ``render_many``. The documents are spread across a pool of native threads, one per CPU unless ``threads`` is given, and the results are returned in order.
+
+.. code:: python
+
+    pages = h.render_many(documents, extensions, render_flags, threads = 4)
+
+    pages = md.render_many(documents)
+
+Custom renderers that override callbacks render their documents one at a time.
+
+Bytes output
+~~~~~~~~~~~~
+
+To skip decoding the HTML into a ``str`` when it is only going to be encoded again, Python 3 can hand it out as UTF-8. Pass ``output = 'bytes'`` to ``render``, or use ``render_into`` to append it to a ``bytearray`` you reuse between calls. ``render_into`` returns the number of bytes appended.
+
+.. code:: python
+
+    body = h.render(text, extensions, render_flags, output = 'bytes')
+
+    page = bytearray()
+    md.render_into(text, page)
+
+Shared references
+~~~~~~~~~~~~~~~~~
+
+Link references used across many documents can be handed to a ``Hoep`` instance once, in Python 3, instead of being added to every document. Pass ``references`` either Markdown reference definitions or a mapping of names to a url or a ``(url, title)`` pair. They are parsed into a table once and looked up after the references a document defines itself. ``load_references`` replaces them later on, and ``load_references(None)`` removes them.
+
+.. code:: python
+
+    md = h.Hoep(extensions, render_flags, references = '[home]: http://example.com/\\n')
+
+    md.load_references({'home': 'http://example.com/', 'docs': ('http://example.com/docs', 'Docs')})
+
 Extensions
 ~~~~~~~~~~
 
@@ -116,6 +160,8 @@ By subclassing the ``Hoep`` class, you can create a custom renderer overriding v
 
     html = md.render('Some ~~bold~~ __"strong"__ text.')
 
+Callback methods are looked up once when the renderer is initialized. If you replace or add callbacks afterwards, call ``refresh()`` so the renderer picks them up.
+
 Callbacks
 ~~~~~~~~~
 
@@ -197,10 +243,15 @@ _sources = [
     'ext/hoedown/html.c',
     'ext/hoedown/html_blocks.c',
     'ext/hoedown/html_smartypants.c',
+    'ext/hoedown/scan.c',
     'ext/hoedown/stack.c',
     'ext/hoedown/version.c'
 ]
 
+if _version == '3':
+    _sources.append('ext/py3k/batch.c')
+    _sources.append('ext/py3k/cache.c')
+
 
 setup(
     name = 'hoep',
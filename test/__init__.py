@@ -2,19 +2,34 @@
 
 from __future__ import absolute_import
 
+from .blocks import BlocksTestCase
+from .buffers import BuffersTestCase
+from .concurrency import ConcurrencyTestCase
 from .custom_renderer import CustomRendererTestCase
 from .extensions import ExtensionsTestCase
+from .inline import InlineTestCase
 from .markdown import MarkdownTestCase
+from .pathological import PathologicalTestCase
+from .references import ReferencesTestCase, SharedReferencesTestCase
 from .render_flags import RenderFlagsTestCase
+from .scanning import ScanningTestCase
 from .smartypants import SmartyPantsTestCase
 from .unicode import UnicodeTestCase
 
 
 __all__ = [
+    'BlocksTestCase',
+    'BuffersTestCase',
+    'ConcurrencyTestCase',
     'CustomRendererTestCase',
     'ExtensionsTestCase',
+    'InlineTestCase',
     'MarkdownTestCase',
+    'PathologicalTestCase',
+    'ReferencesTestCase',
     'RenderFlagsTestCase',
+    'ScanningTestCase',
+    'SharedReferencesTestCase',
     'SmartyPantsTestCase',
     'UnicodeTestCase'
 ]
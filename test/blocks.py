@@ -0,0 +1,35 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+import unittest as ut
+
+import hoep as h
+
+
+class BlocksTestCase(ut.TestCase):
+    def md(self, md, extensions = 0):
+        return h.render(md, extensions)
+    
+    
+    def test_unclosed_html_blocks(self):
+        supplied = '<ins>\ntext\n\n' * 20000
+        expected = '<p><ins>\ntext</p>\n\n' * 20000 + '<ins>x</ins>\n'
+        
+        self.assertEqual(self.md(supplied + '<ins>x</ins>\n'), expected)
+        
+        supplied = 'a\n<div>\n' * 20000
+        expected = '<p>{0}</p>\n'.format(supplied[:-1])
+        
+        self.assertEqual(self.md(supplied, h.EXT_LAX_SPACING), expected)
+    
+    def test_unclosed_html_comments(self):
+        supplied = '<!-- a\n\n' * 20000
+        expected = '\n\n'.join(['<p>&lt;!-- a</p>'] * 20000) + '\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+        
+        supplied = '<hr\n\n' * 20000 + '<p\n\n' * 20000
+        expected = '\n\n'.join(['<p>&lt;hr</p>'] * 20000 + ['<p>&lt;p</p>'] * 20000) + '\n'
+        
+        self.assertEqual(self.md(supplied), expected)
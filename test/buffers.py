@@ -0,0 +1,134 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+from mmap import mmap
+from sys import version_info
+from tempfile import TemporaryFile
+import tracemalloc
+import unittest as ut
+
+import hoep as h
+
+
+@ut.skipIf(version_info < (3,), 'bytes-like input requires Python 3')
+class BuffersTestCase(ut.TestCase):
+    def setUp(self):
+        self.supplied = '*Ünïcödé* text'
+        self.expected = '<p><em>Ünïcödé</em> text</p>\n'
+        
+        self.encoded = self.supplied.encode('utf-8')
+    
+    
+    def test_bytes(self):
+        self.assertEqual(h.render(self.encoded), self.expected)
+        self.assertEqual(h.Hoep().render(self.encoded), self.expected)
+    
+    def test_bytearray(self):
+        self.assertEqual(h.render(bytearray(self.encoded)), self.expected)
+    
+    def test_memoryview(self):
+        view = memoryview(b'xx' + self.encoded)[2:]
+        
+        self.assertEqual(h.render(view), self.expected)
+    
+    def test_mmap(self):
+        with TemporaryFile() as f:
+            f.write(self.encoded)
+            f.flush()
+            
+            m = mmap(f.fileno(), 0)
+            
+            try:
+                self.assertEqual(h.Hoep().render(m), self.expected)
+            finally:
+                m.close()
+    
+    def test_input_unchanged(self):
+        supplied = bytearray(b'> Quoted\n> lines\n')
+        
+        h.render(supplied)
+        
+        self.assertEqual(supplied, bytearray(b'> Quoted\n> lines\n'))
+    
+    def test_preprocess(self):
+        class Renderer(h.Hoep):
+            def preprocess(self, markdown):
+                return markdown.upper()
+        
+        self.assertEqual(Renderer().render(b'*text*'), '<p><em>TEXT</em></p>\n')
+    
+    @ut.skipUnless(hasattr(h, 'render_many'), 'render_many is unavailable')
+    def test_render_many(self):
+        supplied = [self.encoded, bytearray(self.encoded), self.supplied]
+        
+        self.assertEqual(h.render_many(supplied), [self.expected] * 3)
+    
+    def test_output_bytes(self):
+        self.assertEqual(h.render(self.supplied, output = 'bytes'), self.expected.encode('utf-8'))
+        self.assertEqual(h.Hoep().render(self.encoded, output = 'bytes'), self.expected.encode('utf-8'))
+        self.assertEqual(h.render(self.supplied, output = 'str'), self.expected)
+        
+        self.assertRaises(ValueError, h.render, self.supplied, output = 'list')
+    
+    def test_output_bytes_postprocess(self):
+        class Renderer(h.Hoep):
+            def postprocess(self, html):
+                return html.upper()
+        
+        self.assertEqual(Renderer().render('*ü*', output = 'bytes'), '<P><EM>Ü</EM></P>\n'.encode('utf-8'))
+    
+    def test_render_into(self):
+        target = bytearray(b'<!-- -->')
+        renderer = h.Hoep()
+        
+        self.assertEqual(renderer.render_into(self.supplied, target), len(self.expected.encode('utf-8')))
+        self.assertEqual(h.render_into(self.encoded, target), len(self.expected.encode('utf-8')))
+        
+        self.assertEqual(target.decode('utf-8'), '<!-- -->' + self.expected * 2)
+        
+        self.assertRaises(TypeError, renderer.render_into, self.supplied, b'')
+    
+    def test_non_ascii_offsets(self):
+        for i in range(80):
+            supplied = 'x' * i + 'é'
+            
+            self.assertEqual(h.render(supplied), '<p>{0}</p>\n'.format(supplied))
+    
+    def test_buffer_policy(self):
+        renderer = h.Hoep(buffer_limit = 1024, shrink_ratio = 2)
+        
+        self.assertEqual(renderer.buffer_limit, 1024)
+        self.assertEqual(renderer.shrink_ratio, 2)
+        
+        small = 'Some *text*.'
+        large = small * 10000
+        
+        for limit in (0, 1024, 1 << 30):
+            renderer.buffer_limit = limit
+            
+            for supplied in (small, large, small, small, large):
+                self.assertEqual(renderer.render(supplied), h.render(supplied))
+    
+    def test_traced_allocations(self):
+        renderer = h.Hoep()
+        supplied = 'Some *text*.\n\n' * 10000
+        
+        tracemalloc.start()
+        
+        try:
+            before = tracemalloc.get_traced_memory()[0]
+            size = len(renderer.render(supplied))
+            after = tracemalloc.get_traced_memory()[0]
+        finally:
+            tracemalloc.stop()
+        
+        # The output buffer is kept for the next render.
+        self.assertGreaterEqual(after - before, size)
+    
+    def test_invalid_type(self):
+        self.assertRaises(TypeError, h.render, 1)
+        self.assertRaises(TypeError, h.Hoep().render, [])
+    
+    def test_invalid_utf8(self):
+        self.assertRaises(UnicodeDecodeError, h.render, b'\xff\xfe')
@@ -0,0 +1,86 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+from threading import Thread
+import unittest as ut
+
+import hoep as h
+
+
+class ConcurrencyTestCase(ut.TestCase):
+    def setUp(self):
+        self.supplied = '# Header\n\nSome *emphasis*, a [link](http://example.com/) and `code`.\n\n' * 200
+        self.expected = h.render(self.supplied)
+    
+    
+    def _run(self, render, threads = 8):
+        results = []
+        
+        def target():
+            for _ in range(10):
+                results.append(render(self.supplied))
+        
+        workers = [Thread(target = target) for _ in range(threads)]
+        
+        for worker in workers:
+            worker.start()
+        
+        for worker in workers:
+            worker.join()
+        
+        return results
+    
+    
+    def test_module_render(self):
+        results = self._run(h.render)
+        
+        self.assertEqual(len(results), 80)
+        self.assertTrue(all(result == self.expected for result in results))
+    
+    def test_shared_instance(self):
+        results = self._run(h.Hoep().render)
+        
+        self.assertEqual(len(results), 80)
+        self.assertTrue(all(result == self.expected for result in results))
+    
+    
+    @ut.skipUnless(hasattr(h, 'render_many'), 'render_many is not available')
+    def test_render_many(self):
+        supplied = ['{0}\n\n"Quote" -- {1}...'.format(self.supplied, i) for i in range(50)]
+        expected = [h.render(md, h.EXT_QUOTE, h.HTML_SMARTYPANTS) for md in supplied]
+        
+        self.assertEqual(h.render_many(supplied, h.EXT_QUOTE, h.HTML_SMARTYPANTS, threads = 4), expected)
+        self.assertEqual(h.render_many([]), [])
+    
+    @ut.skipUnless(hasattr(h, 'render_many'), 'render_many is not available')
+    def test_instance_render_many(self):
+        class Renderer(h.Hoep):
+            def postprocess(self, html):
+                return html.upper()
+        
+        class SpanRenderer(h.Hoep):
+            def emphasis(self, text):
+                return '[EMPHASIS] {0}'.format(text)
+        
+        supplied = ['Some *emphasis* number {0}.'.format(i) for i in range(20)]
+        
+        for renderer in (h.Hoep(), Renderer(), SpanRenderer()):
+            expected = [renderer.render(md) for md in supplied]
+            
+            self.assertEqual(renderer.render_many(supplied, threads = 4), expected)
+    
+    @ut.skipUnless(hasattr(h, 'clear_cache'), 'clear_cache is not available')
+    def test_cached_engines(self):
+        flags = [(extensions, render_flags) for extensions in (0, h.EXT_TABLES, h.EXT_QUOTE) for render_flags in (0, h.HTML_SMARTYPANTS)]
+        expected = [h.Hoep(*pair).render(self.supplied) for pair in flags]
+        
+        def render(md):
+            h.clear_cache()
+            
+            return [h.render(md, *pair) for pair in flags] == expected
+        
+        results = self._run(render)
+        
+        self.assertEqual(len(results), 80)
+        self.assertTrue(all(results))
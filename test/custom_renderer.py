@@ -2,7 +2,9 @@
 
 from __future__ import unicode_literals
 
+from gc import collect
 from textwrap import dedent
+from weakref import ref
 import unittest as ut
 
 import hoep as h
@@ -268,6 +270,12 @@ class CustomRendererTestCase(ut.TestCase):
         
         self.assertEqual(self.md(supplied, 'span'), expected)
     
+    def test_codespan_empty(self):
+        supplied = '`` ``'
+        expected = '[CODESPAN] '
+        
+        self.assertEqual(self.md(supplied, 'span'), expected)
+    
     def test_double_emphasis(self):
         supplied = '__strong__'
         expected = '[DOUBLE_EMPHASIS] strong'
@@ -359,3 +367,25 @@ class CustomRendererTestCase(ut.TestCase):
         expected = '[NORMAL_TEXT] [ENTITY] &#9731;'
         
         self.assertEqual(self.md(supplied, 'low'), expected)
+    
+    
+    # Method resolution
+    def test_refresh(self):
+        supplied = 'Monkey see.'
+        
+        self.paragraph.paragraph = lambda text: '[PATCHED] {0}'.format(text)
+        
+        self.assertEqual(self.md(supplied, 'paragraph'), '[PARAGRAPH] Monkey see.')
+        
+        self.paragraph.refresh()
+        
+        self.assertEqual(self.md(supplied, 'paragraph'), '[PATCHED] Monkey see.')
+    
+    def test_collected(self):
+        renderer = ParagraphRenderer()
+        reference = ref(renderer)
+        
+        del renderer
+        collect()
+        
+        self.assertIsNone(reference())
@@ -68,6 +68,14 @@ class ExtensionsTestCase(ut.TestCase):
         
         self.assertEqual(self.md(supplied, 'footnotes'), expected)
     
+    def test_footnote_unclosed_fence(self):
+        supplied = 'Code[^1]\n\n[^1]: Note\n\n    ```\n    code'
+        expected = '<pre><code>code</code></pre>\n</li>'
+        
+        extensions = self.extensions['footnotes'] | self.extensions['fenced_code']
+        
+        self.assertIn(expected, h.render(supplied, extensions))
+    
     def test_highlight(self):
         supplied = 'I\'m ==special==.'
         expected = '<p>I&#39;m <mark>special</mark>.</p>\n'
@@ -0,0 +1,48 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+import unittest as ut
+
+import hoep as h
+
+
+class InlineTestCase(ut.TestCase):
+    def md(self, md, extensions = 0):
+        return h.render(md, extensions)
+    
+    
+    def test_unmatched_emphasis(self):
+        supplied = 'x _y ~~z ' * 20000
+        expected = '<p>{0}<em>v</em></p>\n'.format(supplied)
+        
+        self.assertEqual(self.md(supplied + '*v*', h.EXT_STRIKETHROUGH), expected)
+    
+    def test_unmatched_backticks(self):
+        supplied = '`' * 5000 + ' text' * 20000
+        expected = '<p>{0}</p>\n'.format(supplied)
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_shorter_code_span(self):
+        supplied = '```a ``b `c` d'
+        expected = '<p>`<code>a</code>b <code>c</code> d</p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_unmatched_brackets(self):
+        supplied = '[a ' * 20000
+        expected = '<p>{0}<a href="u">b</a></p>\n'.format(supplied)
+        
+        self.assertEqual(self.md(supplied + '[b](u)'), expected)
+        
+        supplied = '[' * 10000
+        expected = '<p>{0}<a href="u">b</a>{1}</p>\n'.format(supplied, ']' * 10000)
+        
+        self.assertEqual(self.md(supplied + '[b](u)' + ']' * 10000), expected)
+    
+    def test_nested_emphasis(self):
+        supplied = '_a *b _c *d* e_'
+        expected = '<p><em>a <em>b _c *d</em> e</em></p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
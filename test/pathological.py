@@ -0,0 +1,130 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import division, unicode_literals
+
+from math import log
+from timeit import default_timer
+import unittest as ut
+
+import hoep as h
+
+
+# Adversarial inputs by kind, each made of n repetitions of a pattern that has
+# at some point sent a parser back over the rest of the document.
+CORPUS = {
+    'deep nesting': [
+        ('blockquotes', lambda n: ('> ' * 40 + 'a\n\n') * n, 0),
+        ('lists', lambda n: ''.join('    ' * (i % 20) + '* a\n' for i in range(n)), 0),
+        ('emphasis', lambda n: '*a **b ' * n + 'c' + '** d*' * n, 0),
+        ('brackets', lambda n: '[' * n + 'a' + ']' * n, 0),
+        ('images', lambda n: '![a](' * n, 0),
+        ('superscripts', lambda n: '^(' * n, h.EXT_SUPERSCRIPT)
+    ],
+    'unmatched emphasis': [
+        ('openers', lambda n: '*a _b **c __d ~~e ==f ' * n, h.EXT_HIGHLIGHT | h.EXT_STRIKETHROUGH),
+        ('closers', lambda n: 'a* b_ c** d__ ' * n, 0),
+        ('intraword', lambda n: 'a_b ' * n, h.EXT_NO_INTRA_EMPHASIS)
+    ],
+    'backtick storms': [
+        ('runs', lambda n: ''.join('`' * (i % 40 + 1) + ' a ' for i in range(n)), 0),
+        ('singles', lambda n: '` a ' * n + '``', 0)
+    ],
+    'bracket storms': [
+        ('inline links', lambda n: '[a ' * n + ']( ' * n, 0),
+        ('references', lambda n: '[a][' * n, 0),
+        ('destinations', lambda n: '[a](' * n, 0)
+    ],
+    'giant tables': [
+        ('rows', lambda n: 'a|b|c\n-|-|-\n' + '1|*2*|`3`\n' * n, h.EXT_TABLES),
+        ('columns', lambda n: '\n'.join('|'.join([c] * n) for c in 'a-b') + '\n', h.EXT_TABLES)
+    ],
+    'reference lists': [
+        ('links', lambda n: ''.join('[a][r{0}] '.format(i) for i in range(n)) + '\n\n' +
+            ''.join('[r{0}]: /u{0} "t"\n'.format(i) for i in range(n)), 0),
+        ('footnotes', lambda n: ''.join('[^f{0}]\n\n[^f{0}]: n\n'.format(i) for i in range(n)), h.EXT_FOOTNOTES)
+    ],
+    'huge html blocks': [
+        ('closed', lambda n: '<div>\n' + '<p>x</p>\n' * n + '</div>\n', 0),
+        ('unclosed', lambda n: '<div>\ntext\n\n' * n, 0),
+        ('lax', lambda n: 'a\n<div>\n' * n, h.EXT_LAX_SPACING),
+        ('comments', lambda n: '<!-- a\n\n' * n, 0),
+        ('inline tags', lambda n: '<a ' * n, 0)
+    ]
+}
+
+
+def render_time(make, extensions, n, repeat = 3):
+    """Best time to render the input of size n, in seconds."""
+    supplied = make(n)
+    best = None
+    
+    for _ in range(repeat):
+        start = default_timer()
+        h.render(supplied, extensions)
+        elapsed = default_timer() - start
+        
+        if best is None or elapsed < best:
+            best = elapsed
+    
+    return best
+
+
+def growth(make, extensions, doublings = 3, floor = 0.001):
+    """Sizes and render times of an input doubled from the first size taking
+    at least floor seconds, which keeps timer noise out of the ratios."""
+    n = 64
+    
+    while n < 1 << 20 and render_time(make, extensions, n, 1) < floor:
+        n *= 2
+    
+    sizes = [n << i for i in range(doublings + 1)]
+    
+    return sizes, [render_time(make, extensions, size) for size in sizes]
+
+
+def exponent(times):
+    """Average power of the size the time grew with, 1 being linear."""
+    return log(times[-1] / times[0], 2) / (len(times) - 1)
+
+
+class PathologicalTestCase(ut.TestCase):
+    # Linear growth gives 1 and quadratic 2; anything past the middle is
+    # measured again before failing, in case the machine was busy.
+    limit = 1.5
+    
+    
+    def assertLinear(self, kind):
+        slow = []
+        
+        for name, make, extensions in CORPUS[kind]:
+            for _ in range(2):
+                power = exponent(growth(make, extensions)[1])
+                
+                if power <= self.limit:
+                    break
+            else:
+                slow.append('{0} ({1:.2f})'.format(name, power))
+        
+        self.assertFalse(slow, 'super-linear {0}: {1}'.format(kind, ', '.join(slow)))
+    
+    
+    def test_deep_nesting(self):
+        self.assertLinear('deep nesting')
+    
+    def test_unmatched_emphasis(self):
+        self.assertLinear('unmatched emphasis')
+    
+    def test_backtick_storms(self):
+        self.assertLinear('backtick storms')
+    
+    def test_bracket_storms(self):
+        self.assertLinear('bracket storms')
+    
+    def test_giant_tables(self):
+        self.assertLinear('giant tables')
+    
+    def test_reference_lists(self):
+        self.assertLinear('reference lists')
+    
+    def test_huge_html_blocks(self):
+        self.assertLinear('huge html blocks')
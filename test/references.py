@@ -0,0 +1,133 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+from sys import version_info
+import unittest as ut
+
+import hoep as h
+
+
+class ReferencesTestCase(ut.TestCase):
+    def setUp(self):
+        self.md = h.Hoep().render
+    
+    
+    def test_case_insensitive(self):
+        supplied = 'A [Link] and [another][LINK].\n\n[link]: http://example.com/ "Title"\n'
+        expected = '<p>A <a href="http://example.com/" title="Title">Link</a> and <a href="http://example.com/" title="Title">another</a>.</p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_hash_collision(self):
+        # Both names hashed to the same value with the old sdbm hash.
+        supplied = '[ziwxnswy], [retpbvpd].\n\n[ziwxnswy]: http://one/\n[retpbvpd]: http://two/\n'
+        expected = '<p><a href="http://one/">ziwxnswy</a>, <a href="http://two/">retpbvpd</a>.</p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_last_definition(self):
+        supplied = '[link].\n\n[link]: http://one/\n[LINK]: http://two/\n'
+        expected = '<p><a href="http://two/">link</a>.</p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_many(self):
+        count = 20000
+        
+        supplied = ''.join('[{0}], '.format(i) for i in range(count)) + '\n\n'
+        supplied += ''.join('[{0}]: http://example.com/{0}\n'.format(i) for i in range(count))
+        
+        expected = ''.join('<a href="http://example.com/{0}">{0}</a>, '.format(i) for i in range(count))
+        
+        self.assertEqual(self.md(supplied), '<p>{0}</p>\n'.format(expected))
+    
+    def test_undefined(self):
+        supplied = '[missing] and [text][missing].\n\n[other]: http://example.com/\n'
+        expected = '<p>[missing] and [text][missing].</p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)
+    
+    def test_many_footnotes(self):
+        count = 2000
+        
+        supplied = ''.join('Note[^n{0}].\n\n'.format(i) for i in reversed(range(count)))
+        supplied += ''.join('[^n{0}]: Footnote {0}.\n\n'.format(i) for i in range(count))
+        
+        html = h.render(supplied, h.EXT_FOOTNOTES)
+        
+        # Footnotes are numbered in order of use, not of definition.
+        self.assertIn('<li id="fn1">\n<p>Footnote {0}.'.format(count - 1), html)
+        self.assertIn('<li id="fn{0}">\n<p>Footnote 0.'.format(count), html)
+    
+    def test_footnote_first_definition(self):
+        supplied = 'Note[^a].\n\n[^a]: First.\n\n[^A]: Second.\n'
+        html = h.render(supplied, h.EXT_FOOTNOTES)
+        
+        self.assertIn('First.', html)
+        self.assertNotIn('Second.', html)
+
+
+@ut.skipIf(version_info < (3,), 'shared references require Python 3')
+class SharedReferencesTestCase(ut.TestCase):
+    def setUp(self):
+        self.definitions = '[home]: http://example.com/\n[Docs]: http://example.com/docs "Docs"\n'
+    
+    
+    def test_markdown(self):
+        md = h.Hoep(references = self.definitions)
+        
+        supplied = 'See [Home] and [the docs][docs].'
+        expected = '<p>See <a href="http://example.com/">Home</a> and <a href="http://example.com/docs" title="Docs">the docs</a>.</p>\n'
+        
+        self.assertEqual(md.render(supplied), expected)
+        self.assertEqual(md.render(supplied.encode('utf-8')), expected)
+    
+    def test_mapping(self):
+        md = h.Hoep(references = {'home': 'http://example.com/', 'docs': ('http://example.com/docs', 'Docs'), 'faq': ('/faq', None)})
+        
+        supplied = '[Home], [docs] and [faq].'
+        expected = '<p><a href="http://example.com/">Home</a>, <a href="http://example.com/docs" title="Docs">docs</a> and <a href="/faq">faq</a>.</p>\n'
+        
+        self.assertEqual(md.render(supplied), expected)
+    
+    def test_document_first(self):
+        md = h.Hoep(references = self.definitions)
+        
+        supplied = '[home]\n\n[HOME]: http://example.org/\n'
+        expected = '<p><a href="http://example.org/">home</a></p>\n'
+        
+        self.assertEqual(md.render(supplied), expected)
+        self.assertEqual(md.render('[home]'), '<p><a href="http://example.com/">home</a></p>\n')
+    
+    def test_load_references(self):
+        md = h.Hoep()
+        
+        self.assertEqual(md.render('[home]'), '<p>[home]</p>\n')
+        
+        md.load_references(self.definitions)
+        self.assertEqual(md.render('[home]'), '<p><a href="http://example.com/">home</a></p>\n')
+        
+        md.load_references({'other': '/'})
+        self.assertEqual(md.render('[home]'), '<p>[home]</p>\n')
+        
+        md.load_references(None)
+        self.assertEqual(md.render('[other]'), '<p>[other]</p>\n')
+    
+    def test_render_many(self):
+        md = h.Hoep(references = self.definitions)
+        
+        expected = '<p><a href="http://example.com/">home</a></p>\n'
+        
+        self.assertEqual(md.render_many(['[home]'] * 8, threads = 4), [expected] * 8)
+    
+    def test_refresh(self):
+        md = h.Hoep(references = self.definitions)
+        md.refresh()
+        
+        self.assertEqual(md.render('[home]'), '<p><a href="http://example.com/">home</a></p>\n')
+    
+    def test_invalid(self):
+        self.assertRaises(TypeError, h.Hoep, references = 1)
+        self.assertRaises(TypeError, h.Hoep, references = {'home': 1})
+        self.assertRaises(TypeError, h.Hoep().load_references, {'home': ('/',)})
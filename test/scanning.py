@@ -0,0 +1,44 @@
+# -*- coding: utf-8 -*-
+
+from __future__ import unicode_literals
+
+import unittest as ut
+
+import hoep as h
+
+
+class ScanningTestCase(ut.TestCase):
+    def setUp(self):
+        self.extensions = (h.EXT_AUTOLINK | h.EXT_HIGHLIGHT | h.EXT_QUOTE |
+            h.EXT_STRIKETHROUGH | h.EXT_SUPERSCRIPT)
+        
+        self.supplied = [
+            '\\*', '`c`', '*e*', '**s**', '[l](u)', '&amp;', '<b>', '^s',
+            '~~d~~', '==h==', '"q"', 'www.x.io', 'a@b.io', 'http://x.io',
+            'l  \nb', 'é€'
+        ]
+    
+    
+    def md(self, md):
+        return h.render(md, self.extensions)
+    
+    
+    # Inputs shorter than 16 bytes are always scanned one byte at a time, so
+    # each span rendered on its own is the reference for the vectorized scan
+    # finding it at every offset of a longer paragraph.
+    def test_offsets(self):
+        for supplied in self.supplied:
+            inner = self.md(supplied)[3:-5]
+            
+            for i in range(1, 66):
+                for j in range(1, 34):
+                    expected = '<p>{0} {1} {2}</p>\n'.format('x' * i, inner, 'y' * j)
+                    
+                    self.assertEqual(self.md('{0} {1} {2}'.format('x' * i, supplied, 'y' * j)), expected)
+    
+    def test_non_ascii_offsets(self):
+        for i in range(1, 66):
+            supplied = 'ü' * i + ' *ë* ' + 'ï' * i
+            expected = '<p>{0} <em>ë</em> {1}</p>\n'.format('ü' * i, 'ï' * i)
+            
+            self.assertEqual(self.md(supplied), expected)
@@ -41,3 +41,9 @@ class SmartyPantsTestCase(ut.TestCase):
         expected = '<p>Non&ndash;zero.</p>\n'
         
         self.assertEqual(self.md(supplied), expected)
+    
+    def test_unclosed_tag(self):
+        supplied = 'Some "text" <pre>'
+        expected = '<p>Some &ldquo;text&rdquo; <pre></p>\n'
+        
+        self.assertEqual(self.md(supplied), expected)